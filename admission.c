@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Admission control.
+ *
+ * Compile using 'gcc -c admission.c' and link admission.o into each
+ * server.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "buf.h"
+#include "response.h"
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+#define LATENCY_WEIGHT 8	/* average weighs each request 1/8 /**/
+#define LATENCY_STALE 1		/* seconds an average stays current /**/
+
+struct admission
+{
+	int maxinflight;		/* 0 means no limit /**/
+	int maxqueue;
+	long maxlatency;		/* microseconds /**/
+	long inflight;			/* admitted and not yet left /**/
+	unsigned long accepted;		/* connections checked /**/
+	unsigned long rejected[ADMIT_REASONS];
+	long latency;			/* moving average, microseconds /**/
+	time_t latency_at;		/* when it was last updated /**/
+};
+
+static const char *reasons[ADMIT_REASONS] = {
+	NULL, "inflight", "queue", "latency", "rate", "client", "memory"
+};
+
+static struct admission *adm;
+
+/*
+ * Set the limits: requests in flight, connections in the listen queue
+ * and average latency in milliseconds, 0 for none. The counters are
+ * mapped shared so forked children update the parent's copy.
+ /**/
+void admission_init(int maxinflight, int maxqueue, int maxlatency)
+{
+	adm = mmap(NULL, sizeof(*adm), PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (adm == MAP_FAILED)
+		err(1, "can't map admission counters");
+	adm->maxinflight = maxinflight;
+	adm->maxqueue = maxqueue;
+	adm->maxlatency = maxlatency * 1000L;
+}
+
+/* Parse a limit given on the command line /**/
+int admission_limit(const char *arg)
+{
+	char *ep;
+	long l;
+
+	l = strtol(arg, &ep, 10);
+	if (*arg == '\0' || *ep != '\0' || l < 0 || l > INT_MAX)
+		errx(1, "limit is not a number: %s", arg);
+	return l;
+}
+
+/* Connections waiting in the accept queue of listening socket sd /**/
+static int admission_queue(int sd)
+{
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	/* On a listening socket tcpi_unacked is the accept queue /**/
+	if (getsockopt(sd, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1)
+		return 0;
+	return ti.tcpi_unacked;
+}
+
+/*
+ * Decide on a connection just accepted from listening socket sd.
+ * ADMIT_OK counts it in flight until admission_leave(); anything else
+ * is the limit it broke, counted as rejected.
+ /**/
+int admission_check(int sd)
+{
+	long inflight;
+	int reason;
+
+	__atomic_add_fetch(&adm->accepted, 1, __ATOMIC_RELAXED);
+	inflight = __atomic_add_fetch(&adm->inflight, 1, __ATOMIC_RELAXED);
+	reason = ADMIT_OK;
+	if (adm->maxinflight > 0 && inflight > adm->maxinflight)
+		reason = ADMIT_INFLIGHT;
+	else if (adm->maxqueue > 0 && admission_queue(sd) > adm->maxqueue)
+		reason = ADMIT_QUEUE;
+	else if (adm->maxlatency > 0 && 
+	    __atomic_load_n(&adm->latency, __ATOMIC_RELAXED) > 
+	    adm->maxlatency && time(NULL) - adm->latency_at <= 
+	    LATENCY_STALE)
+		reason = ADMIT_LATENCY;
+	if (reason != ADMIT_OK)
+	{
+		admission_leave();
+		admission_refused(reason);
+	}
+	return reason;
+}
+
+/* Count a connection the server refused for reason itself /**/
+void admission_refused(int reason)
+{
+	__atomic_add_fetch(&adm->rejected[reason], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Refuse a connection with canned response resp, the 503 or the 429,
+ * without reading its request: one non-blocking send, then what the
+ * client already sent is drained so close() doesn't turn into a reset
+ * that eats the response.
+ /**/
+void admission_reject(int sd, int resp)
+{
+	struct iovec iov[RESP_IOVCNT];
+	struct msghdr msg;
+	char buf[BUF_SIZE];
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = RESP_IOVCNT;
+	response_iov(resp, iov);
+	sendmsg(sd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	shutdown(sd, SHUT_WR);
+	while (recv(sd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+	close(sd);
+}
+
+/* An admitted request is over; safe from a signal handler /**/
+void admission_leave(void)
+{
+	__atomic_sub_fetch(&adm->inflight, 1, __ATOMIC_RELAXED);
+}
+
+/* Fold the latency of a request accepted at start into the average /**/
+void admission_latency(const struct timespec *start)
+{
+	struct timespec now;
+	long sample, avg;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sample = (now.tv_sec - start->tv_sec) * 1000000L + 
+	    (now.tv_nsec - start->tv_nsec) / 1000;
+	/* Racing updates may lose a sample, which an average can afford /**/
+	avg = __atomic_load_n(&adm->latency, __ATOMIC_RELAXED);
+	avg += (sample - avg) / LATENCY_WEIGHT;
+	__atomic_store_n(&adm->latency, avg, __ATOMIC_RELAXED);
+	adm->latency_at = time(NULL);
+}
+
+/* Append the counters as "name value" lines for the status page /**/
+size_t admission_status(struct buf *b)
+{
+	size_t start = b->len;
+	int i;
+
+	buf_printf(b, "accepted %lu\ninflight %ld\nlatency_us %ld\n", 
+	    adm->accepted, adm->inflight, adm->latency);
+	for (i = ADMIT_OK + 1; i < ADMIT_REASONS; i++)
+		buf_printf(b, "rejected_%s %lu\n", reasons[i], 
+		    adm->rejected[i]);
+	return b->len - start;
+}
@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Admission control shared by every server engine.
+ *
+ * Every accepted connection is checked against three limits before
+ * anything is read from it: requests in flight, connections waiting in
+ * the listen queue, and the recent average request latency. One over
+ * its limit is refused at once with the canned 503 and Retry-After
+ * instead of being queued behind work the server can't keep up with.
+ * The counters live in a shared mapping so the children of the process
+ * engines and their parent see the same numbers, exported on STATUS_PATH.
+ */
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/* Outcomes of admission_check() /**/
+#define ADMIT_OK 0
+#define ADMIT_INFLIGHT 1
+#define ADMIT_QUEUE 2
+#define ADMIT_LATENCY 3
+#define ADMIT_RATE 4		/* refused by ratelimit_check() /**/
+#define ADMIT_CLIENT 5
+#define ADMIT_MEMORY 6		/* refused by the memory budget /**/
+#define ADMIT_REASONS 7
+
+struct buf;
+
+void   admission_init(int, int, int);
+int    admission_limit(const char *);
+int    admission_check(int);
+void   admission_refused(int);
+void   admission_reject(int, int);
+void   admission_leave(void);
+void   admission_latency(const struct timespec *);
+size_t admission_status(struct buf *);
+
+#endif /* ADMISSION_H */
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Length-tracked buffers.
+ *
+ * Compile using 'gcc -c buf.c' and link buf.o into each server.
+ */
+
+#include <sys/types.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buf.h"
+#include "memory.h"
+
+/* Defined Variables /**/
+#define BUF_MIN 256		/* first allocation of a growing buffer /**/
+
+/*
+ * Start b empty over size bytes at data, or growing on the heap when
+ * data is NULL.
+ /**/
+void buf_init(struct buf *b, char *data, size_t size)
+{
+	b->data = data;
+	b->len = 0;
+	b->cap = data != NULL ? size : 0;
+	b->fixed = data != NULL;
+	if (b->cap > 0)
+		b->data[0] = '\0';
+}
+
+/*
+ * Make room for n more bytes and a NUL after them, doubling a growing
+ * buffer, whose growth is charged to the memory budget. Returns -1 if
+ * a fixed buffer is too small, the budget refuses or memory is out.
+ /**/
+int buf_reserve(struct buf *b, size_t n)
+{
+	size_t cap;
+	char *data;
+
+	if (b->len + n < b->cap)
+		return 0;
+	if (b->fixed)
+		return -1;
+	for (cap = b->cap > 0 ? b->cap : BUF_MIN; cap <= b->len + n; 
+	    cap *= 2)
+		;
+	if (memory_take(MEM_BUFFERS, cap - b->cap) == -1)
+		return -1;
+	if ((data = realloc(b->data, cap)) == NULL)
+	{
+		memory_give(MEM_BUFFERS, cap - b->cap);
+		return -1;
+	}
+	b->data = data;
+	b->cap = cap;
+	return 0;
+}
+
+/* Append n bytes, as many as fit in a fixed buffer. Returns -1 if cut. /**/
+int buf_append(struct buf *b, const void *p, size_t n)
+{
+	int cut = 0;
+
+	if (buf_reserve(b, n) == -1)
+	{
+		if (b->cap <= b->len)
+			return -1;
+		n = b->cap - b->len - 1;
+		cut = -1;
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+	b->data[b->len] = '\0';
+	return cut;
+}
+
+/*
+ * Append formatted text, as much as fits in a fixed buffer. Returns
+ * the length appended or -1 if it was cut.
+ /**/
+int buf_printf(struct buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(b->cap > b->len ? b->data + b->len : NULL, 
+	    b->cap > b->len ? b->cap - b->len : 0, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return -1;
+	if (b->len + n >= b->cap)
+	{
+		if (buf_reserve(b, n) == -1)
+		{
+			if (b->cap > b->len)
+				b->len = b->cap - 1;
+			return -1;
+		}
+		va_start(ap, fmt);
+		vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+		va_end(ap);
+	}
+	b->len += n;
+	return n;
+}
+
+/* Empty b, freeing the heap storage of a growing buffer /**/
+void buf_free(struct buf *b)
+{
+	if (b->fixed)
+	{
+		b->len = 0;
+		if (b->cap > 0)
+			b->data[0] = '\0';
+		return;
+	}
+	free(b->data);
+	memory_give(MEM_BUFFERS, b->cap);
+	buf_init(b, NULL, 0);
+}
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Length-tracked buffers shared by every server engine.
+ *
+ * A struct buf knows how many bytes it holds and how many it has room
+ * for, so responses are built by appending at the end, never by
+ * scanning for a NUL, and may hold any bytes. A buffer over storage of
+ * the caller's is fixed and cuts what doesn't fit; one started empty
+ * grows on the heap. A slice points at bytes of another buffer.
+ */
+
+#ifndef BUF_H
+#define BUF_H
+
+#include <sys/types.h>
+
+/* Bytes of a buffer, not NUL terminated /**/
+struct slice
+{
+	const char *ptr;
+	size_t len;
+};
+
+struct buf
+{
+	char *data;
+	size_t len;		/* bytes held /**/
+	size_t cap;		/* bytes data has room for /**/
+	int fixed;		/* data is the caller's, never grown /**/
+};
+
+void   buf_init(struct buf *, char *, size_t);
+int    buf_reserve(struct buf *, size_t);
+int    buf_append(struct buf *, const void *, size_t);
+int    buf_printf(struct buf *, const char *, ...)
+           __attribute__((format(printf, 2, 3)));
+void   buf_free(struct buf *);
+
+#endif /* BUF_H */
@@ -0,0 +1,237 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runtime configuration: config file, host limits and the report of
+ * effective values.
+ *
+ * Compile using 'gcc -c config.c' and link config.o into the server.
+ */
+
+/* sched_getaffinity() /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "config.h"
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+#define CGROUP_MEMORY "/sys/fs/cgroup/memory.max"
+
+/* Effective values, "name value" lines /**/
+static char report[CONFIG_REPORT];
+static size_t reportlen;
+
+/*
+ * Read the options in the file at path, each "name value" line given
+ * to set as the short option of the long option called name would be.
+ * Comments from # and blank lines are skipped.
+ /**/
+void config_load(const char *path, const struct option *opts, 
+    void (*set)(int, char *))
+{
+	char line[BUF_SIZE];
+	char *name, *value, *p;
+	const struct option *o;
+	FILE *f;
+	int n;
+
+	if ((f = fopen(path, "r")) == NULL)
+		err(1, "can't open %s", path);
+	for (n = 1; fgets(line, sizeof(line), f) != NULL; n++)
+	{
+		if (strchr(line, '\n') == NULL && !feof(f))
+			errx(1, "%s:%d: line too long", path, n);
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		name = line + strspn(line, " \t\r\n");
+		if (*name == '\0')
+			continue;
+		p = name + strcspn(name, " \t\r\n");
+		value = p + strspn(p, " \t\r\n");
+		*p = '\0';
+		/* Trailing blanks aren't part of the value /**/
+		for (p = value + strlen(value); p > value && 
+		    isspace((unsigned char)p[-1]); p--)
+			;
+		*p = '\0';
+		for (o = opts; o->name != NULL; o++)
+			if (strcmp(o->name, name) == 0)
+				break;
+		if (o->name == NULL)
+			errx(1, "%s:%d: unknown option %s", path, n, name);
+		if (*value == '\0')
+			errx(1, "%s:%d: %s needs a value", path, n, name);
+		/* Options keep pointers to their value /**/
+		if ((value = strdup(value)) == NULL)
+			err(1, "config_load failed");
+		set(o->val, value);
+	}
+	if (ferror(f))
+		err(1, "can't read %s", path);
+	fclose(f);
+}
+
+/* Parse a size in bytes, with an optional k, m or g suffix /**/
+size_t config_size(const char *s)
+{
+	unsigned long long n;
+	char *ep;
+	int shift;
+
+	errno = 0;
+	n = strtoull(s, &ep, 10);
+	if (*s == '\0' || *s == '-' || errno == ERANGE)
+		errx(1, "bad size %s", s);
+	shift = 0;
+	switch (tolower((unsigned char)*ep))
+	{
+	case 'g':
+		shift = 30;
+		ep++;
+		break;
+	case 'm':
+		shift = 20;
+		ep++;
+		break;
+	case 'k':
+		shift = 10;
+		ep++;
+		break;
+	}
+	if (*ep != '\0' || n > (SIZE_MAX / 2) >> shift)
+		errx(1, "bad size %s", s);
+	return n << shift;
+}
+
+/* CPUs this process may run on /**/
+int config_cpus(void)
+{
+	cpu_set_t set;
+	long n;
+
+	if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		return CPU_COUNT(&set);
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
+/*
+ * Raise the open file limit as far as it may go and return it. Every
+ * connection needs a descriptor, and one more for a file being read.
+ /**/
+int config_files(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == -1)
+		err(1, "getrlimit failed");
+	if (rl.rlim_cur < rl.rlim_max)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		/* A container may refuse, keep what was there /**/
+		if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+			getrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > INT_MAX)
+		return INT_MAX;
+	return rl.rlim_cur;
+}
+
+/* Bytes of physical memory, or of the cgroup limit when lower /**/
+size_t config_memory(void)
+{
+	unsigned long long limit;
+	size_t mem;
+	FILE *f;
+
+	mem = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+	/* "max" when the cgroup has no limit /**/
+	if ((f = fopen(CGROUP_MEMORY, "r")) != NULL)
+	{
+		if (fscanf(f, "%llu", &limit) == 1 && limit < mem)
+			mem = limit;
+		fclose(f);
+	}
+	return mem;
+}
+
+/* Add the effective value of name to the report /**/
+void config_report(const char *name, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (reportlen < sizeof(report))
+		reportlen += snprintf(report + reportlen, 
+		    sizeof(report) - reportlen, "%s ", name);
+	if (reportlen < sizeof(report))
+	{
+		va_start(ap, fmt);
+		reportlen += vsnprintf(report + reportlen, 
+		    sizeof(report) - reportlen, fmt, ap);
+		va_end(ap);
+	}
+	if (reportlen < sizeof(report))
+		reportlen += snprintf(report + reportlen, 
+		    sizeof(report) - reportlen, "\n");
+	if (reportlen >= sizeof(report))
+		reportlen = sizeof(report) - 1;
+}
+
+/* Print the report on stderr, before the server detaches /**/
+void config_print(void)
+{
+	const char *p, *e;
+
+	for (p = report; *p != '\0'; p = e + 1)
+	{
+		if ((e = strchr(p, '\n')) == NULL)
+			break;
+		warnx("%.*s", (int)(e - p), p);
+	}
+}
+
+/* Append the report for the status page, as "config_name value" /**/
+size_t config_status(struct buf *b)
+{
+	const char *p, *e;
+	size_t start = b->len;
+
+	for (p = report; (e = memchr(p, '\n', report + reportlen - p)) 
+	    != NULL; p = e + 1)
+	{
+		buf_append(b, "config_", 7);
+		buf_append(b, p, e + 1 - p);
+	}
+	return b->len - start;
+}
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runtime configuration of the server.
+ *
+ * Every option can also be given in a file of "name value" lines, one
+ * per option named as its long flag, with # starting a comment:
+ *
+ *	engine epoll
+ *	max-conn 4096
+ *	cache 256m
+ *
+ * Limits that used to be compiled in default to what the host offers:
+ * the CPUs this process may run on, the open file limit and physical
+ * memory, the lower of it and a cgroup's limit. The effective values
+ * are collected as "name value" lines, reported once at startup and
+ * on the status page.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <sys/types.h>
+#include <getopt.h>
+
+/* Defined Variables /**/
+#define CONFIG_REPORT 2048	/* room for the effective values /**/
+
+struct buf;
+
+void   config_load(const char *, const struct option *, 
+           void (*)(int, char *));
+size_t config_size(const char *);
+int    config_cpus(void);
+int    config_files(void);
+size_t config_memory(void);
+void   config_report(const char *, const char *, ...);
+void   config_print(void);
+size_t config_status(struct buf *);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,557 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Copyright (c) 2008 Bob Beck <beck@obtuse.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+/*
+ * Request core of the blocking engines.
+ *
+ * Compile using 'gcc -c core.c' and link core.o into the server.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "core.h"
+#include "doccache.h"
+#include "encoding.h"
+#include "filecache.h"
+#include "gzcache.h"
+#include "listener.h"
+#include "logfile.h"
+#include "range.h"
+#include "request.h"
+#include "response.h"
+#include "shmcache.h"
+#include "snapshot.h"
+#include "status.h"
+#include "syscount.h"
+#include "transmit.h"
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+static void serve(int, struct request *, char *, size_t);
+static int read_request(int, struct request *);
+static int serve_snapshot(int, struct request *, const char *, char *, 
+    FILE *);
+static int serve_shared(int, struct request *, char *, FILE *);
+static int write_to_client(int, struct buf *);
+static off_t write_OK(int, struct request *, FILE *, struct fileinfo *,
+    const char *);
+static void write_error(int, int);
+
+char dir_documents[PATH_MAX];
+static size_t doclen;		/* length of dir_documents /**/
+static int shared;		/* documents cached in shared memory /**/
+
+/*
+ * Serve documents from the directory documents, cached in shared memory
+ * when shared is set, in this process's body cache otherwise.
+ /**/
+void core_init(const char *documents, int share)
+{
+	doclen = strlcpy(dir_documents, documents, sizeof(dir_documents));
+	shared = share;
+}
+
+/*
+ * Name the file of path, a slice of the request, in a buffer of size
+ * bytes. Returns the path within the name, NULL if the name doesn't fit,
+ * which every engine answers 404.
+ /**/
+const char * core_file(char *file, size_t size, const struct slice *path)
+{
+	if (snprintf(file, size, "%s%.*s", dir_documents, (int)path->len, 
+	    path->ptr) >= size)
+		return NULL;
+	return file + doclen;
+}
+
+/*
+ * Answer one request on connection sd from client ip, a buffer of size
+ * bytes the name a local proxy forwards for replaces, and log it. The
+ * request is kept in a struct request from the pool, not on the stack.
+ /**/
+void core_serve(int sd, char *ip, size_t size)
+{
+	struct request *req;
+
+	if ((req = request_get()) == NULL)
+	{
+		write_error(sd, RESP_INTERNAL_SERVER_ERROR);
+		return;
+	}
+	serve(sd, req, ip, size);
+	request_put(req);
+}
+
+/* Answer the request read into req, as core_serve() /**/
+static void serve(int sd, struct request *req, char *ip, size_t size)
+{
+	struct iovec iov[SHM_IOVCNT];
+	struct fileinfo fi;
+	struct rangeset rs;
+	struct shmslot *slot;
+	struct gzentry *gz;
+	struct docentry *doc;
+	const char *body, *path;
+	struct buf out;
+	char msg[HDR_SIZE];
+	char name[SHM_PATH];
+	size_t len;
+	ssize_t w;
+	FILE *file;
+	FILE *logfile;
+	off_t total_written;
+	int read;
+	int ranges;
+
+	/* Read request /**/
+	read = read_request(sd, req);
+	/* The local proxy says who the client is /**/
+	if (listener_local(ip))
+		request_forwarded(req->head, ip, size);
+
+	/* Open log file, handle file errors /**/
+	if ((logfile = logfile_open()) == NULL)
+	{
+		write_error(sd, RESP_INTERNAL_SERVER_ERROR);
+		return;
+	}
+	if (read == -1)
+	{
+		/* Blank line failed /**/
+		write_error(sd, RESP_BAD_REQUEST);
+		logfile_write(logfile, req->head, "400 Bad Request", ip);
+		return;
+	}
+	else if (read == -2)
+	{
+		/* Read failed /**/
+		write_error(sd, RESP_INTERNAL_SERVER_ERROR);
+		logfile_write(logfile, "", "500 Internal Server Error", ip);
+		return;
+	}
+	/* Retrieve directory of getline /**/
+	if ((req->method = request_parse(req->head, &req->path)) == -1)
+	{
+		write_error(sd, RESP_BAD_REQUEST);
+		logfile_write(logfile, req->head, "400 Bad Request", ip);
+		return;
+	}
+
+	/* The file asked for, the path is what follows the documents /**/
+	if ((path = core_file(req->file, sizeof(req->file), &req->path)) == 
+	    NULL)
+	{
+		write_error(sd, RESP_NOT_FOUND);
+		logfile_write(logfile, req->head, "404 Not Found", ip);
+		return;
+	}
+
+	/* The server's own counters, no file is needed /**/
+	if (status_request(path, ip))
+	{
+		buf_init(&out, NULL, 0);
+		if (status_response(&out) == 0)
+		{
+			write_error(sd, RESP_SERVICE_UNAVAILABLE);
+			logfile_write(logfile, req->head, 
+			    "503 Service Unavailable", ip);
+		}
+		else
+		{
+			write_to_client(sd, &out);
+			logfile_write(logfile, req->head, "200 OK", ip);
+		}
+		buf_free(&out);
+		return;
+	}
+
+	/* Answer from the snapshot when it holds the document /**/
+	if (serve_snapshot(sd, req, path, ip, logfile) == 0)
+		return;
+
+	/* Answer from the cache shared by all processes on a hit /**/
+	if (shared && serve_shared(sd, req, ip, logfile) == 0)
+		return;
+
+	errno = 0;
+	file = SYSCOUNT(SC_OPEN, fopen(req->file, "r"));
+	if (errno == EACCES)
+	{
+		/* Forbidden /**/
+		write_error(sd, RESP_FORBIDDEN);
+		logfile_write(logfile, req->head, "403 Forbidden", ip);
+		return;
+	}
+	if (file == NULL || 
+	    filecache_stat(req->file, fileno(file), &fi) == -1)
+	{
+		/* Not Found /**/
+		if (file != NULL)
+			SYSCOUNT(SC_CLOSE, fclose(file));
+		write_error(sd, RESP_NOT_FOUND);
+		logfile_write(logfile, req->head, "404 Not Found", ip);
+		return;
+	}
+
+	/* Serve a pre-compressed sidecar if the client takes one /**/
+	file = request_negotiate(req->head, req->file, file, &fi);
+	/* Or a gzip copy made on the fly /**/
+	gz = request_compress(req->head, req->file, &fi);
+
+	/* Client copy is current, send the validators only /**/
+	if (request_not_modified(req->head, &fi))
+	{
+		buf_init(&out, msg, sizeof(msg));
+		response_header(&out, "304 Not Modified", NULL, -1, &fi, NULL);
+		write_to_client(sd, &out);
+		logfile_write(logfile, req->head, "304 Not Modified", ip);
+		if (gz != NULL)
+			gzcache_put(gz);
+		SYSCOUNT(SC_CLOSE, fclose(file));
+		return;
+	}
+
+	/* Client asked for part of the file /**/
+	if (req->method == METHOD_GET && 
+	    (ranges = request_range(req->head, &fi, &rs)) != 0)
+	{
+		buf_init(&out, msg, sizeof(msg));
+		range_header(&rs, &fi, &out);
+		write_to_client(sd, &out);
+		if (ranges == -1)
+			logfile_write(logfile, req->head, 
+			    "416 Range Not Satisfiable", ip);
+		else
+		{
+			snprintf(msg, sizeof(msg), 
+			    "206 Partial Content %lld/%lld", (long long)
+			    range_write(sd, fileno(file), &rs), 
+			    (long long)rs.length);
+			logfile_write(logfile, req->head, msg, ip);
+		}
+		SYSCOUNT(SC_CLOSE, fclose(file));
+		return;
+	}
+
+	/*
+	 * Body from memory: kept in shared memory for later processes,
+	 * or loaded once however many threads miss.
+	 /**/
+	slot = NULL;
+	doc = NULL;
+	body = NULL;
+	if (gz != NULL)
+		body = gz->data;
+	else if (req->method == METHOD_GET && shared)
+	{
+		/* Names too long for a slot are never cached /**/
+		if (snprintf(name, sizeof(name), "%s%s", req->file, 
+		    fi.encoding == ENC_IDENTITY ? "" : 
+		    encoding_suffix(fi.encoding)) < sizeof(name))
+			slot = shmcache_fill(name, fileno(file), &fi);
+	}
+	else if (req->method == METHOD_GET &&
+	    (doc = doccache_get(req->file, &fi, 1)) != NULL &&
+	    doccache_state(doc) == DC_READY)
+		body = doc->data;
+
+	/* Write the file to the client /**/
+	if (slot != NULL)
+	{
+		len = shmcache_iov(slot, iov);
+		transmit_size(sd, len);
+		if ((w = writev_all(sd, iov, SHM_IOVCNT)) == -1)
+			total_written = 0;
+		else
+			total_written = w - (len - fi.size);
+		shmcache_put(slot);
+	}
+	else
+		total_written = write_OK(sd, req, file, &fi, body);
+	if (gz != NULL)
+		gzcache_put(gz);
+	if (doc != NULL)
+		doccache_put(doc);
+	snprintf(msg, sizeof(msg), "200 OK %lld/%lld", 
+	    (long long)total_written, (long long)fi.size);
+	logfile_write(logfile, req->head, msg, ip);
+
+	/* Close file /**/
+	SYSCOUNT(SC_CLOSE, fclose(file));
+}
+
+/*
+ * Answer a request for path from the current snapshot: 304, 206, 416 or
+ * a 200 written straight from the mapped archive. Returns -1 without
+ * writing anything if there is no snapshot or it doesn't hold path.
+ /**/
+static int serve_snapshot(int sd, struct request *req, const char *path,
+    char *ip, FILE *logfile)
+{
+	struct iovec iov[SNAP_IOVCNT];
+	struct snapshot *snap;
+	const struct snapentry *e;
+	struct fileinfo fi;
+	struct rangeset rs;
+	struct buf out;
+	char msg[HDR_SIZE];
+	size_t len;
+	ssize_t w;
+	int ranges;
+
+	if ((snap = snapshot_get()) == NULL)
+		return -1;
+	if ((e = request_snapshot(req->head, snap, path, &fi)) == NULL)
+	{
+		snapshot_put(snap);
+		return -1;
+	}
+
+	if (request_not_modified(req->head, &fi))
+	{
+		buf_init(&out, msg, sizeof(msg));
+		response_header(&out, "304 Not Modified", NULL, -1, &fi, NULL);
+		write_to_client(sd, &out);
+		logfile_write(logfile, req->head, "304 Not Modified", ip);
+	}
+	else if (req->method == METHOD_GET &&
+	    (ranges = request_range(req->head, &fi, &rs)) != 0)
+	{
+		buf_init(&out, msg, sizeof(msg));
+		range_header(&rs, &fi, &out);
+		write_to_client(sd, &out);
+		if (ranges == -1)
+			logfile_write(logfile, req->head, 
+			    "416 Range Not Satisfiable", ip);
+		else
+		{
+			/* Ranges are read from the archive at the body /**/
+			rs.base = e->v[fi.encoding].body;
+			snprintf(msg, sizeof(msg), 
+			    "206 Partial Content %lld/%lld", (long long)
+			    range_write(sd, snap->fd, &rs),
+			    (long long)rs.length);
+			logfile_write(logfile, req->head, msg, ip);
+		}
+	}
+	else
+	{
+		len = snapshot_iov(snap, e, fi.encoding, iov);
+		transmit_size(sd, len);
+		if (req->method == METHOD_HEAD)
+		{
+			writev_all(sd, iov, SNAP_IOVCNT - 1);
+			w = 0;
+		}
+		else if ((w = writev_all(sd, iov, SNAP_IOVCNT)) == -1)
+			w = 0;
+		else
+			w -= len - fi.size;
+		snprintf(msg, sizeof(msg), "200 OK %lld/%lld", (long long)w,
+		    (long long)fi.size);
+		logfile_write(logfile, req->head, msg, ip);
+	}
+	snapshot_put(snap);
+	return 0;
+}
+
+/*
+ * Answer a request for its file from the cache shared by the processes,
+ * picking a cached sidecar as request_negotiate() would. Returns -1
+ * without writing anything on a miss; ranges are always left to the
+ * file.
+ /**/
+static int serve_shared(int sd, struct request *req, char *ip, 
+    FILE *logfile)
+{
+	struct iovec iov[SHM_IOVCNT];
+	struct shmslot *slot, *eslot;
+	struct fileinfo fi;
+	struct slice range;
+	struct slice value;
+	struct buf out;
+	char msg[HDR_SIZE];
+	char name[SHM_PATH];
+	size_t len;
+	ssize_t w;
+	int enc;
+
+	if (request_find(req->head, "Range", &range) != -1 ||
+	    (slot = shmcache_get(req->file)) == NULL)
+		return -1;
+	shmcache_info(slot, &fi);
+	if (fi.encodings != 0 && 
+	    request_find(req->head, "Accept-Encoding", &value) != -1 && 
+	    (enc = encoding_select(&value, fi.encodings)) != ENC_IDENTITY)
+	{
+		/* A name too long for a slot was never cached /**/
+		eslot = NULL;
+		if (snprintf(name, sizeof(name), "%s%s", req->file, 
+		    encoding_suffix(enc)) < sizeof(name))
+			eslot = shmcache_get(name);
+		shmcache_put(slot);
+		if ((slot = eslot) == NULL)
+			return -1;
+		shmcache_info(slot, &fi);
+	}
+
+	if (request_not_modified(req->head, &fi))
+	{
+		buf_init(&out, msg, sizeof(msg));
+		response_header(&out, "304 Not Modified", NULL, -1, &fi, NULL);
+		write_to_client(sd, &out);
+		logfile_write(logfile, req->head, "304 Not Modified", ip);
+		shmcache_put(slot);
+		return 0;
+	}
+
+	len = shmcache_iov(slot, iov);
+	transmit_size(sd, len);
+	if (req->method == METHOD_HEAD)
+	{
+		writev_all(sd, iov, SHM_IOVCNT - 1);
+		w = 0;
+	}
+	else if ((w = writev_all(sd, iov, SHM_IOVCNT)) == -1)
+		w = 0;
+	else
+		w -= len - fi.size;
+	snprintf(msg, sizeof(msg), "200 OK %lld/%lld", (long long)w,
+	    (long long)fi.size);
+	logfile_write(logfile, req->head, msg, ip);
+	shmcache_put(slot);
+	return 0;
+}
+
+/*
+ * Read the request head sent by the client into req. Returns its
+ * length, -1 if it doesn't end in a blank line or -2 if the read failed.
+ /**/
+static int read_request(int sd, struct request *req)
+{
+	char *buffer = req->head;
+	size_t maxread;
+	ssize_t r, rc;
+	int reading;
+
+	r = -1;
+	rc = 0;
+	maxread = sizeof(req->head) - 1;
+	reading = 1;
+	buffer[0] = '\0';
+
+	while (r != 0 && rc < maxread && reading)
+	{
+		r = SYSBYTES(SC_READ, read(sd, buffer + rc, maxread - rc));
+		if (r == -1)
+		{
+			if (errno != EINTR)
+				return -2;
+			continue;
+		}
+		/* Only what was just read can hold the newline /**/
+		if (memchr(buffer + rc, '\n', r) != NULL)
+			reading = 0;
+		rc += r;
+	}
+
+	buffer[rc] = '\0';
+	req->len = rc;
+	/* check for blank line /**/
+	if (rc >= 2 && buffer[rc - 1] == '\n' && buffer[rc - 2] == '\n')
+		return rc;
+	else if (rc >= 3 && buffer[rc - 1] == '\n' && 
+	    buffer[rc - 2] == '\r' && buffer[rc - 3] == '\n')
+		return rc;
+	else
+		return -1;
+}
+
+/* Write everything held in b to the client /**/
+static int write_to_client(int sd, struct buf *b)
+{
+	struct iovec iov;
+
+	iov.iov_base = b->data;
+	iov.iov_len = b->len;
+	return writev_all(sd, &iov, 1);
+}
+
+/*
+ * Write a 200 OK response to the client, HEAD gets the header only. The
+ * body is read from file through the buffer of req, or taken from data
+ * when not NULL.
+ /**/
+static off_t write_OK(int sd, struct request *req, FILE *file, 
+    struct fileinfo *fi, const char *data)
+{
+	struct iovec iov;
+	off_t total_written = 0;
+	ssize_t written = 0;
+	char *buffer = req->out;
+	struct buf out;
+
+	transmit_size(sd, fi->size);
+	buf_init(&out, buffer, sizeof(req->out));
+	response_header(&out, "200 OK", NULL, fi->size, fi, NULL);
+	write_to_client(sd, &out);
+	if (req->method == METHOD_HEAD)
+		return 0;
+	if (data != NULL)
+	{
+		iov.iov_base = (char *)data;
+		iov.iov_len = fi->size;
+		written = writev_all(sd, &iov, 1);
+		return written == -1 ? 0 : written;
+	}
+	while ((iov.iov_len = SYSBYTES(SC_FILE, fread(buffer, 1, 
+	    sizeof(req->out), file))) > 0)
+	{
+		iov.iov_base = buffer;
+		written = writev_all(sd, &iov, 1);
+		if (written == -1)
+			return total_written;
+		else 
+			total_written += written;
+	}
+	return total_written;
+}
+
+/* Write a canned error response to the client /**/
+static void write_error(int sd, int resp)
+{
+	struct iovec iov[RESP_IOVCNT];
+
+	response_iov(resp, iov);
+	writev_all(sd, iov, RESP_IOVCNT);
+}
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Request core of the blocking engines.
+ *
+ * fork, prefork, thread and pool hand each connection to core_serve(),
+ * which reads one request, answers it and logs it. Documents come from
+ * the snapshot first, then from a cache: in shared memory when the
+ * engine's processes share it, otherwise the body cache and the gzip
+ * copies made on the fly, shared by threads. The event engines answer
+ * the same requests without blocking, with the same request helpers.
+ */
+
+#ifndef CORE_H
+#define CORE_H
+
+#include <sys/types.h>
+#include <limits.h>
+
+struct slice;
+
+/* Directory documents are served from /**/
+extern char dir_documents[PATH_MAX];
+
+void         core_init(const char *, int);
+void         core_serve(int, char *, size_t);
+const char * core_file(char *, size_t, const struct slice *);
+
+#endif /* CORE_H */
@@ -0,0 +1,333 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cache of document bodies.
+ *
+ * Compile using 'gcc -c doccache.c' and link doccache.o into a server
+ * with -lpthread.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "doccache.h"
+#include "encoding.h"
+#include "filecache.h"
+#include "lrucache.h"
+#include "memory.h"
+#include "syscount.h"
+
+/* Function Prototypes /**/
+static void dc_drop(struct lrunode *);
+
+static struct lrucache cache;
+static struct docentry *queue_head, *queue_tail;
+static pthread_mutex_t dclock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dcdone = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dcwork = PTHREAD_COND_INITIALIZER;
+static size_t dc_budget;		/* bytes of cached bodies /**/
+static int dc_async;
+static int dc_pipe[2] = { -1, -1 };
+
+/* Free an entry nobody uses any more, giving back what it held /**/
+static void dc_free(struct docentry *e)
+{
+	if (e->state == DC_READY)
+		memory_give(MEM_CACHES, e->size);
+	memory_give(MEM_CACHES, sizeof(*e));
+	free(e->node.key);
+	free(e->data);
+	free(e);
+}
+
+/* Drop an entry from the cache, freeing it once unused. Hold dclock. /**/
+static void dc_drop(struct lrunode *n)
+{
+	struct docentry *e = (struct docentry *)n;
+
+	lru_remove(&cache, n);
+	e->dead = 1;
+	if (e->refs == 0)
+		dc_free(e);
+}
+
+/*
+ * Read the file of e, returning its body or NULL if the file can't be
+ * read, is no longer the version e was made for or the memory budget
+ * refuses the body.
+ /**/
+static char * dc_read(struct docentry *e)
+{
+	struct stat st;
+	char *data;
+	off_t got;
+	ssize_t r;
+	int fd;
+
+	if ((fd = SYSCOUNT(SC_OPEN, open(e->node.key, O_RDONLY))) == -1)
+		return NULL;
+	if (SYSCOUNT(SC_OPEN, fstat(fd, &st)) == -1 || st.st_dev != e->dev || 
+	    st.st_ino != e->ino || st.st_size != e->size || 
+	    st.st_mtime != e->mtime || 
+	    memory_take(MEM_CACHES, e->size) == -1)
+	{
+		SYSCOUNT(SC_CLOSE, close(fd));
+		return NULL;
+	}
+	if ((data = malloc(e->size)) == NULL)
+	{
+		memory_give(MEM_CACHES, e->size);
+		SYSCOUNT(SC_CLOSE, close(fd));
+		return NULL;
+	}
+	for (got = 0; got < e->size; got += r)
+	{
+		r = SYSBYTES(SC_FILE, pread(fd, data + got, e->size - got, 
+		    got));
+		if (r == -1 && errno == EINTR)
+			r = 0;
+		else if (r <= 0)
+			break;
+	}
+	SYSCOUNT(SC_CLOSE, close(fd));
+	if (got != e->size)
+	{
+		memory_give(MEM_CACHES, e->size);
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+/*
+ * Read the file of e and publish the outcome to everyone subscribed,
+ * then drop the loader's reference. A failed entry leaves the cache so
+ * a later request tries again.
+ /**/
+static void dc_load(struct docentry *e)
+{
+	char *data;
+	char c = 0;
+
+	data = dc_read(e);
+
+	pthread_mutex_lock(&dclock);
+	if (data == NULL)
+	{
+		e->state = DC_FAILED;
+		if (!e->dead)
+			dc_drop(&e->node);
+	}
+	else
+	{
+		e->data = data;
+		e->state = DC_READY;
+		if (!e->dead)
+		{
+			lru_charge(&cache, &e->node, e->size);
+			lru_evict(&cache, dc_budget, &e->node);
+		}
+	}
+	e->refs--;
+	if (e->dead && e->refs == 0)
+		dc_free(e);
+	pthread_cond_broadcast(&dcdone);
+	pthread_mutex_unlock(&dclock);
+
+	/* Wake the event loop, a full pipe already has a wakeup pending /**/
+	if (dc_async)
+		write(dc_pipe[1], &c, 1);
+}
+
+/* Loader thread of an event loop server /**/
+static void * dc_loader(void *arg)
+{
+	struct docentry *e;
+
+	while (1)
+	{
+		pthread_mutex_lock(&dclock);
+		while (queue_head == NULL)
+			pthread_cond_wait(&dcwork, &dclock);
+		e = queue_head;
+		queue_head = e->qnext;
+		if (queue_head == NULL)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&dclock);
+
+		dc_load(e);
+		syscount_flush();
+	}
+	return NULL;
+}
+
+/*
+ * Set the cache up to keep budget bytes of bodies. async makes loads
+ * run on a loader thread that signals doccache_fd(), for servers that
+ * can't block on a load.
+ /**/
+void doccache_init(int async, size_t budget)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	cache.drop = dc_drop;
+	dc_budget = budget;
+	dc_async = async;
+	memory_shrinker(doccache_shrink);
+	if (!async)
+		return;
+	if (pipe(dc_pipe) == -1 || 
+	    fcntl(dc_pipe[0], F_SETFL, O_NONBLOCK) == -1 ||
+	    fcntl(dc_pipe[1], F_SETFL, O_NONBLOCK) == -1)
+		err(1, "unable to create loader pipe");
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, dc_loader, NULL) != 0)
+		err(1, "unable to create loader thread");
+	pthread_attr_destroy(&attr);
+}
+
+/* Descriptor readable once a load finished, -1 when not async /**/
+int doccache_fd(void)
+{
+	return dc_pipe[0];
+}
+
+/* Clear the wakeups of doccache_fd() before checking parked requests /**/
+void doccache_drain(void)
+{
+	char buf[64];
+
+	while (read(dc_pipe[0], buf, sizeof(buf)) > 0)
+		;
+}
+
+/*
+ * Return the body of the document at path described by fi, held for
+ * the caller until doccache_put(). The entry may still be DC_LOADING
+ * when wait is 0; with wait set the call returns once the load is
+ * over. Callers fall back to reading the file themselves on DC_FAILED.
+ * Returns NULL for documents not kept in the cache.
+ /**/
+struct docentry * doccache_get(const char *path, const struct fileinfo *fi,
+    int wait)
+{
+	struct docentry *e;
+	char key[1024];
+
+	if (fi->size <= 0 || fi->size > DC_MAX)
+		return NULL;
+	/* A sidecar is cached under its own name /**/
+	if (snprintf(key, sizeof(key), "%s%s", path, fi->encoding == 
+	    ENC_IDENTITY ? "" : encoding_suffix(fi->encoding)) >= 
+	    sizeof(key))
+		return NULL;
+
+	pthread_mutex_lock(&dclock);
+	e = (struct docentry *)lru_find(&cache, key);
+	/* Drop bodies of an older version of the file /**/
+	if (e != NULL && (e->dev != fi->dev || e->ino != fi->ino || 
+	    e->size != fi->size || e->mtime != fi->mtime))
+	{
+		dc_drop(&e->node);
+		e = NULL;
+	}
+	if (e != NULL)
+	{
+		/* Hit, or subscribe to the load in flight /**/
+		e->refs++;
+		lru_touch(&cache, &e->node);
+		while (wait && e->state == DC_LOADING)
+			pthread_cond_wait(&dcdone, &dclock);
+		pthread_mutex_unlock(&dclock);
+		return e;
+	}
+
+	/* First miss, this request starts the load /**/
+	if ((e = calloc(1, sizeof(*e))) == NULL || 
+	    (e->node.key = strdup(key)) == NULL)
+	{
+		free(e);
+		pthread_mutex_unlock(&dclock);
+		return NULL;
+	}
+	e->dev = fi->dev;
+	e->ino = fi->ino;
+	e->size = fi->size;
+	e->mtime = fi->mtime;
+	e->state = DC_LOADING;
+	/* One reference for the caller and one for the loader /**/
+	e->refs = 2;
+	e->node.bytes = sizeof(*e);
+	lru_insert(&cache, &e->node);
+	memory_charge(MEM_CACHES, sizeof(*e));
+	lru_evict(&cache, dc_budget, &e->node);
+	if (wait)
+	{
+		pthread_mutex_unlock(&dclock);
+		dc_load(e);
+		return e;
+	}
+	if (queue_tail != NULL)
+		queue_tail->qnext = e;
+	else
+		queue_head = e;
+	queue_tail = e;
+	pthread_cond_signal(&dcwork);
+	pthread_mutex_unlock(&dclock);
+	return e;
+}
+
+/* State of an entry, which the loader may be changing /**/
+int doccache_state(struct docentry *e)
+{
+	int state;
+
+	pthread_mutex_lock(&dclock);
+	state = e->state;
+	pthread_mutex_unlock(&dclock);
+	return state;
+}
+
+/* Release a body returned by doccache_get() /**/
+void doccache_put(struct docentry *e)
+{
+	pthread_mutex_lock(&dclock);
+	e->refs--;
+	if (e->dead && e->refs == 0)
+		dc_free(e);
+	pthread_mutex_unlock(&dclock);
+}
+
+/* Drop the least recently used half of the cached bytes /**/
+void doccache_shrink(void)
+{
+	pthread_mutex_lock(&dclock);
+	lru_evict(&cache, cache.bytes / 2, NULL);
+	pthread_mutex_unlock(&dclock);
+}
@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cache of document bodies with single-flight loading.
+ *
+ * Only one load of a file version is ever in flight. The first request
+ * to miss starts it and every request for the same version that comes
+ * in while it runs subscribes to that load instead of reading the file
+ * again. Threaded servers load in the first caller and block the others
+ * until it is done; an event loop has the loads done by a loader thread
+ * and parks its connections until doccache_fd() turns readable.
+ */
+
+#ifndef DOCCACHE_H
+#define DOCCACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "filecache.h"
+#include "lrucache.h"
+
+/* Defined Variables /**/
+#define DC_MAX (1024 * 1024)		/* largest body kept /**/
+
+/* States of an entry /**/
+#define DC_LOADING 0
+#define DC_READY 1
+#define DC_FAILED 2
+
+struct docentry
+{
+	struct lrunode node;		/* key is the file read, sidecar /**/
+	struct docentry *qnext;		/* loader queue /**/
+	dev_t dev;			/* version of the file /**/
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	int state;			/* DC_LOADING, DC_READY or DC_FAILED /**/
+	int refs;			/* users of data, and the loader /**/
+	int dead;			/* dropped from the cache /**/
+	char *data;			/* body, size bytes /**/
+};
+
+void              doccache_init(int, size_t);
+int               doccache_fd(void);
+void              doccache_drain(void);
+struct docentry * doccache_get(const char *, const struct fileinfo *, int);
+int               doccache_state(struct docentry *);
+void              doccache_put(struct docentry *);
+void              doccache_shrink(void);
+
+#endif /* DOCCACHE_H */
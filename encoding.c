@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Content codings and Accept-Encoding negotiation.
+ *
+ * Compile using 'gcc -c encoding.c' and link encoding.o into each server.
+ */
+
+#include <sys/types.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "buf.h"
+#include "encoding.h"
+
+static const char *names[ENC_COUNT] = { "identity", "gzip", "zstd", "br" };
+static const char *suffixes[ENC_COUNT] = { "", ".gz", ".zst", ".br" };
+
+/* Name of a coding as used in Content-Encoding, ie) "gzip" /**/
+const char * encoding_name(int enc)
+{
+	return names[enc];
+}
+
+/* File name suffix of the sidecar holding a coding, ie) ".gz" /**/
+const char * encoding_suffix(int enc)
+{
+	return suffixes[enc];
+}
+
+/* Return the coding whose sidecar suffix path ends with, or 0 if none /**/
+int encoding_suffixed(const char *path)
+{
+	size_t len, slen;
+	int enc;
+
+	len = strlen(path);
+	for (enc = ENC_IDENTITY + 1; enc < ENC_COUNT; enc++)
+	{
+		slen = strlen(suffixes[enc]);
+		if (len > slen && strcmp(path + len - slen, suffixes[enc]) == 0)
+			return enc;
+	}
+	return ENC_IDENTITY;
+}
+
+/*
+ * Pick the coding to send from the codings in the available mask, given
+ * the value of an Accept-Encoding header. Codings the client lists with
+ * a non-zero q (or covers with "*") are acceptable; among those the
+ * server's own preference order wins. Returns ENC_IDENTITY if none.
+ * The value is a slice of the request head, read where it lies.
+ /**/
+int encoding_select(const struct slice *accept, int available)
+{
+	const char *p, *end, *next, *param;
+	size_t len, n;
+	int accepted, refused, star, enc, i;
+	double q;
+
+	accepted = refused = star = 0;
+	end = accept->ptr + accept->len;
+	for (p = accept->ptr; p < end; p = next + 1)
+	{
+		if ((next = memchr(p, ',', end - p)) == NULL)
+			next = end;
+		while (p < next && (*p == ' ' || *p == '\t'))
+			p++;
+		q = 1.0;
+		if ((param = memchr(p, ';', next - p)) != NULL)
+		{
+			len = param - p;
+			param++;
+			while (param < next && 
+			    (*param == ' ' || *param == '\t'))
+				param++;
+			if (next - param >= 2 && 
+			    strncasecmp(param, "q=", 2) == 0)
+				q = strtod(param + 2, NULL);
+		}
+		else
+			len = next - p;
+		for (n = 0; n < len && p[n] != ' ' && p[n] != '\t'; n++)
+			;
+		len = n;
+
+		if (len == 1 && *p == '*')
+		{
+			star = q > 0 ? 1 : -1;
+			continue;
+		}
+		for (i = ENC_IDENTITY + 1; i < ENC_COUNT; i++)
+			if (strlen(names[i]) == len && 
+			    strncasecmp(p, names[i], len) == 0)
+			{
+				if (q > 0)
+					accepted |= ENC_BIT(i);
+				else
+					refused |= ENC_BIT(i);
+			}
+	}
+	if (star == 1)
+		accepted |= ~refused;
+
+	for (enc = ENC_COUNT - 1; enc > ENC_IDENTITY; enc--)
+		if ((available & accepted & ENC_BIT(enc)) != 0)
+			return enc;
+	return ENC_IDENTITY;
+}
@@ -0,0 +1,45 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Content codings understood by the servers.
+ *
+ * A document may have pre-compressed sidecars next to it (asg2.html.gz,
+ * asg2.html.br, asg2.html.zst) made ahead of time by precompress.sh.
+ * The set of sidecars a file has is kept as a bit mask of codings.
+ */
+
+#ifndef ENCODING_H
+#define ENCODING_H
+
+/* Content codings, in increasing order of preference /**/
+#define ENC_IDENTITY 0
+#define ENC_GZIP 1
+#define ENC_ZSTD 2
+#define ENC_BR 3
+#define ENC_COUNT 4
+
+#define ENC_BIT(e) (1 << (e))
+
+struct slice;
+
+const char * encoding_name(int);
+const char * encoding_suffix(int);
+int          encoding_suffixed(const char *);
+int          encoding_select(const struct slice *, int);
+
+#endif /* ENCODING_H */
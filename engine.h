@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Concurrency engines of the server.
+ *
+ * server.c parses the options into a struct engineconf and runs the
+ * engine --engine names; server_f, server_p and server_s are the same
+ * program with fork, thread and select as their default. Every engine
+ * answers requests with the same request core and caches, so they only
+ * differ in how connections are spread:
+ *
+ *	fork	a child process for each connection
+ *	prefork	-w processes, each accepting and serving in turn
+ *	thread	a thread for each connection
+ *	pool	one acceptor thread handing off to -w worker threads
+ *	select	one event loop per process, or per CPU with -n,
+ *	epoll	waiting with select(), epoll or io_uring poll
+ *	uring	requests
+ *
+ * An engine calls engine_setup() once in each process that serves,
+ * after forking any it needs, then runs until the server is killed.
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <sys/types.h>
+#include <signal.h>
+
+/* How an engine's requests share the caches /**/
+#define ENGINE_PROCESS 0	/* processes, through shared memory /**/
+#define ENGINE_THREAD 1		/* threads, blocking on loads /**/
+#define ENGINE_EVENT 2		/* one loop, loads on a thread /**/
+
+/* Stack of a thread serving requests, the request is kept off it /**/
+#define ENGINE_STACK (64 * 1024)
+
+/* How the pool acceptor places connections /**/
+#define DIST_RR 0		/* next worker in turn /**/
+#define DIST_LEAST 1		/* least loaded worker /**/
+#define DIST_SHARED 2		/* one queue all workers take from /**/
+
+struct engineconf
+{
+	const char *engine;	/* name of the engine /**/
+	int model;		/* ENGINE_PROCESS, _THREAD or _EVENT /**/
+	u_short port;
+	int sd;			/* TCP listener, opened by engine_setup() /**/
+	int usd;		/* Unix domain listener or -1 /**/
+	char *documents;
+	char *snapshot;
+	int maxconn;		/* connections open in one process /**/
+	size_t cache;		/* bytes of cached bodies, gzip half that /**/
+	size_t memlimit;	/* -G ceiling of the memory budget /**/
+	int maxinflight, maxqueue, maxlatency;
+	int rate, burst, perclient;
+	int txpolicy, sndbuf, lowat;
+	int gzip_level;
+	int syscalls;		/* -Y count the I/O calls of requests /**/
+	int trace;		/* -R turns kept of each event loop /**/
+	int workers;		/* -w pool threads or prefork processes /**/
+	size_t stack;		/* -K stack of a serving thread /**/
+	int dist;		/* -d how the pool picks a worker /**/
+	int cores;		/* -n event loops per CPU, -1 for one /**/
+	sigset_t hup;		/* SIGHUP, SIGUSR1/2, blocked until waiting /**/
+};
+
+/* Set on SIGHUP, SIGUSR1, SIGUSR2, acted on by engine_signalled() /**/
+extern volatile sig_atomic_t reload;
+extern volatile sig_atomic_t dump;
+extern volatile sig_atomic_t dumptrace;
+
+void engine_setup(struct engineconf *, int);
+void engine_signalled(void);
+int  engine_spawn(int, int, sigset_t *);
+
+void fork_run(struct engineconf *);
+void prefork_run(struct engineconf *);
+void thread_run(struct engineconf *);
+void pool_run(struct engineconf *);
+void event_run(struct engineconf *);
+
+#endif /* ENGINE_H */
@@ -0,0 +1,1069 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Copyright (c) 2008 Bob Beck <beck@obtuse.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+/*
+ * Event engines: one loop per process serves every connection without
+ * blocking, waiting on them with select(), epoll or io_uring as the
+ * engine's name says. With -n there is one loop per CPU, each pinned
+ * there with its own listening socket, connections, caches and log
+ * buffer.
+ *
+ * Compile using 'gcc -c engine_event.c' and link it into the server.
+ */
+
+/* accept4() /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "buf.h"
+#include "core.h"
+#include "doccache.h"
+#include "engine.h"
+#include "filecache.h"
+#include "gzcache.h"
+#include "hotpath.h"
+#include "listener.h"
+#include "logfile.h"
+#include "looptrace.h"
+#include "memory.h"
+#include "poller.h"
+#include "range.h"
+#include "ratelimit.h"
+#include "request.h"
+#include "response.h"
+#include "snapshot.h"
+#include "status.h"
+#include "syscount.h"
+#include "transmit.h"
+
+/* Defined variables /**/
+#define BUF_SIZE 4096
+#define EVENT_BATCH 64		/* ready fds handled per wait /**/
+#define SCHED_QUANTUM (64 * 1024) /* most bytes written to one per turn /**/
+#define SCHED_TURN (1024 * 1024) /* most bytes written in all per turn /**/
+#define EVENT_PAUSE 100		/* ms between checks while not accepting /**/
+#define STATE_UNUSED 0
+#define STATE_READING 1
+#define STATE_WRITING 2
+#define STATE_PARKED 3
+
+struct connectiondata {
+	FILE *logfile;          /* logfile file /**/
+	struct sockaddr_in sa;  /* connection sockaddr /**/
+	char ip[PEER_SIZE];     /* value of the connection ip /**/
+	char date[80];          /* Date spliced into a canned response /**/
+	struct iovec iov[SNAP_IOVCNT]; /* pieces left to write /**/
+	int iovcnt;             /* number of pieces left to write /**/
+	struct buf in;          /* request read so far /**/
+	struct buf out;         /* response header and any body read /**/
+	int sd; 	        /* connection socket data /**/
+	int state; 	        /* the state of the connection /**/
+	int ok;		        /* request OK value /**/
+	int method;             /* METHOD_GET or METHOD_HEAD /**/
+	const char *status;     /* status logged once a body is written /**/
+	size_t slen;            /* the sockaddr length of the connection /**/
+	size_t bs;	        /* total buffer size /**/
+	size_t bl;	        /* total buffer left to read/write /**/
+	size_t w;	        /* written bytes number /**/
+	size_t hl;	        /* header length of a 200 OK response /**/
+	unsigned age;           /* turns passed over while writable /**/
+	struct docentry *doc;   /* cached body sent or waited for /**/
+	struct gzentry *gz;     /* gzip copy the body is sent from /**/
+	FILE *file;             /* document read if the load fails /**/
+	int fd;                 /* descriptor the body is streamed from /**/
+	off_t foff;             /* next byte of fd to send /**/
+	size_t fl;              /* bytes of fd left to send after iov /**/
+	struct rangeset rs;     /* ranges streamed, none for a whole body /**/
+	int part;               /* next part of rs to queue /**/
+	char delim[RANGE_PART]; /* delimiter before that part /**/
+	struct snapshot *snap;  /* snapshot the response points into /**/
+	struct connectiondata *pprev; /* list of those parked on loads /**/
+	struct connectiondata *pnext;
+	struct timespec start;  /* when the connection was accepted /**/
+	struct scset sc;        /* calls made for it, charged when closed /**/
+};
+
+/* Function prototypes /**/
+static struct connectiondata * get_free_conn(void);
+static void checklisten(int, int);
+static void set_state(struct connectiondata *, int);
+static void unlink_parked(struct connectiondata *);
+static void closecon(struct connectiondata *, int);
+static ssize_t handlewrite(struct connectiondata *, size_t);
+static void schedule(struct connectiondata **, int);
+static int  sched_cmp(const void *, const void *);
+static void handleread(struct connectiondata *);
+static void read_success(struct connectiondata *);
+static void unpark(struct connectiondata *);
+static int  read_snapshot(struct connectiondata *, const char *);
+static int  set_write_content(struct connectiondata *);
+static void stream_file(struct connectiondata *, FILE *, size_t);
+static void stream_ranges(struct connectiondata *, int, 
+    const struct rangeset *);
+static void queue_part(struct connectiondata *);
+static void write_OK_log(struct connectiondata *);
+static void write_size_log(struct connectiondata *, const char *, off_t, 
+    off_t);
+static void write_to_log(const char *, const char *, 
+    struct connectiondata *);
+static void write_error(struct connectiondata *, int);
+
+/* Global variables /**/
+static struct connectiondata *connections;
+static int nconnections;
+static int nstates[LT_STATES];	/* connections in each state /**/
+static struct connectiondata *parked;	/* waiting for a load /**/
+
+/* Event engine: run the loop, in each of -n processes if asked to /**/
+void event_run(struct engineconf *c)
+{
+	struct pollready ready[EVENT_BATCH];
+	struct connectiondata *writers[EVENT_BATCH];
+	struct connectiondata *cp, *next;
+	long long t;
+	int cpu = -1, dcfd, i, n, nwriters, paused = 0;
+
+	/* The Unix domain socket is shared, every loop drains it /**/
+	if (c->usd != -1 && fcntl(c->usd, F_SETFL, fcntl(c->usd, F_GETFL) |
+	    O_NONBLOCK) == -1)
+		err(1, "fcntl failed");
+
+	/*
+	 * One process per CPU. Everything from here on, the listening
+	 * socket, counters, caches and their threads, is its own.
+	 /**/
+	if (c->cores >= 0)
+	{
+		cpu = engine_spawn(c->cores, 1, &c->hup);
+		logfile_buffer();
+	}
+	hotpath_worker();
+
+	/*
+	 * Every core listens on the port, its connections stay on its
+	 * CPU. Nonblocking so checklisten() can accept until the queue
+	 * is empty. SIGHUP must interrupt the wait, not land on the
+	 * helper threads, so they are started with it blocked.
+	 /**/
+	engine_setup(c, cpu);
+	sigprocmask(SIG_UNBLOCK, &c->hup, NULL);
+	if (fcntl(c->sd, F_SETFL, fcntl(c->sd, F_GETFL) | O_NONBLOCK) == -1)
+		err(1, "fcntl failed");
+	if (poller_init(c->engine) == -1)
+		errx(1, "no poller for engine %s", c->engine);
+	looptrace_loop(cpu);
+
+	/*
+	 * Setup all connection structs. The table is held for good and
+	 * charged to the memory budget, of which it may take half; past
+	 * that connections are refused as when all are in use.
+	 /**/
+	nconnections = c->maxconn;
+	if (nconnections > c->memlimit / 2 / sizeof(*connections))
+		nconnections = c->memlimit / 2 / sizeof(*connections);
+	if (nconnections < 1)
+		nconnections = 1;
+	if ((connections = calloc(nconnections, sizeof(*connections))) 
+	    == NULL)
+		err(1, "can't allocate connections");
+	memory_charge(MEM_BUFFERS, nconnections * sizeof(*connections));
+	for (i = 0; i < nconnections; i++)
+		closecon(&connections[i], 1);
+
+	/* The listen and loader fds, told apart from connections by fd /**/
+	dcfd = doccache_fd();
+	poller_set(c->sd, POLLER_IN, NULL);
+	poller_set(dcfd, POLLER_IN, NULL);
+	if (c->usd != -1)
+		poller_set(c->usd, POLLER_IN, NULL);
+
+	/* Accept connections /**/
+	while (1)
+	{
+		/* Reload the snapshot, dump the hot paths if signalled /**/
+		engine_signalled();
+
+		/*
+		 * Leave clients queued while memory is short, checking
+		 * again every EVENT_PAUSE ms. The caches were shrunk.
+		 /**/
+		if (memory_pressure() != paused)
+		{
+			paused = !paused;
+			if (paused)
+				memory_paused();
+			poller_set(c->sd, paused ? 0 : POLLER_IN, NULL);
+			if (c->usd != -1)
+				poller_set(c->usd, paused ? 0 : POLLER_IN, 
+				    NULL);
+		}
+
+		/*
+		 * Buffered log lines and hot path counts go out at least
+		 * once a second. The wait serves no one connection, and is
+		 * idle with none.
+		 /**/
+		looptrace_wait();
+		n = SYSCOUNT(nstates[STATE_UNUSED] == nconnections ? SC_IDLE :
+		    SC_WAIT, poller_wait(ready, EVENT_BATCH, paused ? 
+		    EVENT_PAUSE : logfile_pending() || hotpath_pending() ? 
+		    1000 : -1));
+		looptrace_woke(n);
+		if (n == -1 && errno != EINTR)
+			err(1, "%s failed", c->engine);
+		t = looptrace_begin();
+		logfile_tick();
+		hotpath_tick();
+		looptrace_end(t, LT_LOG, -1);
+		nwriters = 0;
+		for (i = 0; i < n; i++)
+		{
+			t = looptrace_begin();
+			/* Accept every new connection /**/
+			if (ready[i].fd == c->sd)
+			{
+				checklisten(c->sd, 0);
+				looptrace_end(t, LT_ACCEPT, c->sd);
+			}
+			else if (ready[i].fd == c->usd)
+			{
+				checklisten(c->usd, 1);
+				looptrace_end(t, LT_ACCEPT, c->usd);
+			}
+			/* A load finished, resume whoever waited for it /**/
+			else if (ready[i].fd == dcfd)
+			{
+				doccache_drain();
+				for (cp = parked; cp != NULL; cp = next)
+				{
+					next = cp->pnext;
+					if (doccache_state(cp->doc) == 
+					    DC_LOADING)
+						continue;
+					syscount_begin(&cp->sc);
+					unpark(cp);
+					syscount_end();
+				}
+				looptrace_end(t, LT_LOAD, dcfd);
+			}
+			/*
+			 * Or a connection to read, or to write once the
+			 * batch is scheduled. One closed earlier in this
+			 * batch may be stale, skip it.
+			 /**/
+			else
+			{
+				cp = ready[i].data;
+				if (cp->sd != ready[i].fd)
+					continue;
+				if (cp->state == STATE_READING &&
+				    (ready[i].events & POLLER_IN))
+				{
+					syscount_begin(&cp->sc);
+					handleread(cp);
+					syscount_end();
+					looptrace_end(t, LT_READ, 
+					    ready[i].fd);
+				}
+				else if (cp->state == STATE_WRITING &&
+				    (ready[i].events & POLLER_OUT))
+					writers[nwriters++] = cp;
+			}
+		}
+		schedule(writers, nwriters);
+		looptrace_done(nstates);
+		/* Waits, accepts and log flushes of the turn /**/
+		syscount_flush();
+	}
+}
+
+/*
+ * Write to the writable connections of a turn, the least left to send
+ * first, up to SCHED_QUANTUM bytes to each and SCHED_TURN in all. So a
+ * small response isn't queued behind big transfers or favored by its
+ * slot. Those passed over once the turn is spent are still writable
+ * and come back next turn, older: the age divides what is left, so a
+ * big transfer still moves while small ones keep arriving.
+ /**/
+static void schedule(struct connectiondata **writers, int n)
+{
+	size_t budget = SCHED_TURN;
+	long long t;
+	ssize_t w;
+	int i, sd;
+
+	qsort(writers, n, sizeof(*writers), sched_cmp);
+	for (i = 0; i < n; i++)
+	{
+		if (budget == 0)
+		{
+			writers[i]->age++;
+			continue;
+		}
+		writers[i]->age = 0;
+		/* The connection may be closed by the write /**/
+		sd = writers[i]->sd;
+		t = looptrace_begin();
+		syscount_begin(&writers[i]->sc);
+		w = handlewrite(writers[i], budget < SCHED_QUANTUM ? budget :
+		    SCHED_QUANTUM);
+		syscount_end();
+		looptrace_end(t, LT_WRITE, sd);
+		budget -= (size_t)w < budget ? (size_t)w : budget;
+	}
+}
+
+/* Order writers by bytes left over one plus their age /**/
+static int sched_cmp(const void *a, const void *b)
+{
+	const struct connectiondata *ca = *(struct connectiondata **)a;
+	const struct connectiondata *cb = *(struct connectiondata **)b;
+	size_t ka = ca->bl / (ca->age + 1);
+	size_t kb = cb->bl / (cb->age + 1);
+
+	return ka < kb ? -1 : ka > kb;
+}
+
+/*
+ * Move a connection to state, waiting for what that state needs. Those
+ * parked are kept on a list, so a finished load looks at them alone.
+ /**/
+static void set_state(struct connectiondata *cp, int state)
+{
+	if (cp->state == STATE_PARKED)
+		unlink_parked(cp);
+	if (state == STATE_PARKED)
+	{
+		cp->pprev = NULL;
+		cp->pnext = parked;
+		if (parked != NULL)
+			parked->pprev = cp;
+		parked = cp;
+	}
+	nstates[cp->state]--;
+	nstates[state]++;
+	cp->state = state;
+	poller_set(cp->sd, state == STATE_READING ? POLLER_IN :
+	    state == STATE_WRITING ? POLLER_OUT : 0, cp);
+}
+
+/*
+ * Accept every connection waiting on the listen queue, not one per
+ * select(). For each get client IP and, if free connections exist,
+ * set it to state reading. local is set for the Unix domain socket,
+ * whose clients have no address.
+ /**/
+static void checklisten(int sd, int local)
+{
+	struct connectiondata *cp;
+	struct sockaddr_in sa;
+	int newsd, reason;
+	socklen_t slen;
+	
+	for (;;) {
+		memset(&sa, 0, sizeof(sa));
+		slen = sizeof(sa);
+		newsd = SYSCOUNT(SC_ACCEPT, accept4(sd, local ? NULL : 
+		    (struct sockaddr *)&sa, local ? NULL : &slen, 
+		    SOCK_NONBLOCK | SOCK_CLOEXEC));
+		if (newsd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			err(1, "accept failed");
+		}
+
+		/* Over a limit, refuse before reading anything /**/
+		if (admission_check(sd) != ADMIT_OK) {
+			admission_reject(newsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		/* So is a client over its own limits /**/
+		if ((reason = ratelimit_check(sa.sin_addr.s_addr)) !=
+		    ADMIT_OK) {
+			admission_leave();
+			admission_refused(reason);
+			admission_reject(newsd, RESP_TOO_MANY_REQUESTS);
+			continue;
+		}
+
+		cp = get_free_conn();
+		if (cp == NULL) {
+			/* No connections, refuse /**/
+			ratelimit_leave(sa.sin_addr.s_addr);
+			admission_leave();
+			admission_refused(ADMIT_INFLIGHT);
+			admission_reject(newsd, RESP_SERVICE_UNAVAILABLE);
+		} else {
+			/* New Connection, set reading /**/
+			memcpy(&cp->sa, &sa, sizeof(sa));
+			cp->sd = newsd;
+			set_state(cp, STATE_READING);
+			transmit_open(newsd);
+			cp->slen = slen;
+			/* get IP of client /**/
+			if (local)
+				listener_peer(newsd, cp->ip, sizeof(cp->ip));
+			else
+				inet_ntop(AF_INET, &(sa.sin_addr), cp->ip,
+				    sizeof(cp->ip));
+			cp->w = 0;
+			cp->ok = 0;
+			clock_gettime(CLOCK_MONOTONIC, &cp->start);
+		}
+	}
+}
+
+/*
+ * Handle connection to write to, assume is writable. Write at most max
+ * bytes, from the pending pieces and then the file being streamed, and
+ * return how many were written. Close the connection after completed
+ /**/
+static ssize_t handlewrite(struct connectiondata *cp, size_t max)
+{
+	struct iovec iov[SNAP_IOVCNT];
+	ssize_t i;
+	int cnt;
+	
+	/* Size the send buffer before the first write of the response /**/
+	if (cp->w == 0)
+		transmit_size(cp->sd, cp->bl);
+	/* A range body queues each part as the last is written /**/
+	if (cp->iovcnt == 0 && cp->fl == 0 && cp->part <= cp->rs.count &&
+	    cp->rs.count > 0)
+		queue_part(cp);
+	/* The pending pieces, cut off after max bytes /**/
+	for (cnt = 0; cnt < cp->iovcnt && max > 0; cnt++) {
+		iov[cnt] = cp->iov[cnt];
+		if (iov[cnt].iov_len > max)
+			iov[cnt].iov_len = max;
+		max -= iov[cnt].iov_len;
+	}
+	/* We can safely do one write, due to check by select /**/
+	if (cnt > 0)
+		i = SYSBYTES(SC_WRITE, writev(cp->sd, iov, cnt));
+	else
+		i = SYSBYTES(SC_WRITE, sendfile(cp->sd, cp->fd, &cp->foff, 
+		    cp->fl < max ? cp->fl : max));
+	/* A streamed file that got shorter ends the response short /**/
+	if (i == 0 && cnt == 0) {
+		errno = EIO;
+		i = -1;
+	}
+	if (i == -1) {
+		if (errno != EAGAIN) {
+			/* the write failed /**/
+			if (cp->ok)
+				write_OK_log(cp);
+			closecon(cp, 0);
+
+		}		
+		return 0;
+	} else {
+		/* Drop the written bytes from what is pending /**/
+		if (cnt > 0)
+			cp->iovcnt = iov_advance(cp->iov, cp->iovcnt, i);
+		else
+			cp->fl -= i;
+		cp->bl -= i;  /* Decrement amount  left to write /**/
+		cp->w += i;   /* Record written characters /**/
+	}	
+	if (cp->bl == 0) {
+		transmit_close(cp->sd);
+		if (cp->ok) 
+			write_OK_log(cp);
+		closecon(cp, 0);
+	}
+	return i;
+}
+
+/* Connection has readable data,. If newline, change to writing state /**/
+static void handleread(struct connectiondata *cp)
+{
+	ssize_t i;
+	char *bp;
+	
+	if (cp->in.cap - cp->in.len < 10 && 
+	    buf_reserve(&cp->in, BUF_SIZE) == -1) {
+		/* we're out of memory /**/
+		closecon(cp, 0);
+		return;
+	}
+	
+        /* We can safely do one read, due to check by select /**/
+	i = SYSBYTES(SC_READ, read(cp->sd, cp->in.data + cp->in.len, 
+	    cp->in.cap - cp->in.len - 1));
+	if (i == 0) {
+		cp->logfile = logfile_open();
+		if (cp->logfile != NULL)
+			write_to_log("", "500 Internal Server Error", cp);
+		closecon(cp, 0);
+		return;
+	}
+	if (i == -1) {
+		if (errno != EAGAIN) {
+			/* read failed /**/
+			write_error(cp, RESP_INTERNAL_SERVER_ERROR);
+			set_state(cp, STATE_WRITING);
+			cp->logfile = logfile_open();
+			if (cp->logfile != NULL)
+				write_to_log("", "500 Internal Server Error",
+				    cp);
+		}
+		/*
+		 * note if EAGAIN, we just return, and let our caller
+		 * decide to call us again when socket is readable
+		 /**/
+		return;
+	}
+	/*
+	 * ok we really got something read. change where we're
+	 * pointing
+	 /**/
+	cp->in.len += i;
+	cp->in.data[cp->in.len] = '\0';
+	bp = cp->in.data + cp->in.len;
+
+	char * cur;
+	/* check if we read atleast the first line /**/
+	for (cur = cp->in.data; cur < bp; cur++)
+	{
+		if ( *cur == '\n')
+		{
+			/* open log file /**/
+			cp->logfile = logfile_open();
+			if (cp->logfile == NULL)
+				write_error(cp, RESP_INTERNAL_SERVER_ERROR);
+			else 
+			{
+				/* missing blank line /**/
+				if ( (*(bp-2) != '\n' || *(bp-1) != '\n')
+				    &&
+				    (*(bp-2) != '\r' || *(bp-1) != '\n' ||
+				    *(bp-3) != '\n' ) )
+				{
+					write_error(cp, RESP_BAD_REQUEST);
+					write_to_log(cp->in.data, 
+					    "400 Bad Request", cp);
+				}
+				else 
+					read_success(cp);
+			}
+			
+			/* Parked requests write once their body is loaded /**/
+			if (cp->state != STATE_PARKED)
+				set_state(cp, STATE_WRITING);
+			return;
+		}
+	}
+}
+
+/* Handle sucessful read /**/
+static void read_success(struct connectiondata *cp)
+{
+	struct fileinfo fi;
+	struct rangeset rs;
+	struct gzentry *gz;
+	struct slice path;
+	const char *name;
+	FILE *file;
+	char dir[PATH_MAX];
+	int ranges;
+
+	/* The local proxy says who the client is /**/
+	if (listener_local(cp->ip))
+		request_forwarded(cp->in.data, cp->ip, sizeof(cp->ip));
+
+	/*
+	 * The request line is logged from the head, which is kept until
+	 * the connection closes.
+	 /**/
+	if ((cp->method = request_parse(cp->in.data, &path)) == -1)
+	{
+		write_error(cp, RESP_BAD_REQUEST);
+		write_to_log(cp->in.data, "400 Bad Request", cp);
+	}
+	else if ((name = core_file(dir, sizeof(dir), &path)) == NULL)
+	{
+		/* Named as the blocking engines name it /**/
+		write_error(cp, RESP_NOT_FOUND);
+		write_to_log(cp->in.data, "404 Not Found", cp);
+	}
+	else if (status_request(name, cp->ip))
+	{
+		/* The server's own counters /**/
+		status_response(&cp->out);
+		if (set_write_content(cp) == 0)
+			write_to_log(cp->in.data, "200 OK", cp);
+	}
+	else
+	{
+		/* Answer from the snapshot when it holds the document /**/
+		if (read_snapshot(cp, name) == 0)
+			return;
+
+		/* get the requested file /**/
+		errno = 0;
+		file = SYSCOUNT(SC_OPEN, fopen(dir, "r"));
+		if (errno == EACCES)
+		{
+			/* file non-readable /**/
+			write_error(cp, RESP_FORBIDDEN);
+			write_to_log(cp->in.data, "403 Forbidden", cp);
+			return;
+		}
+		if (file == NULL || 
+		    filecache_stat(dir, fileno(file), &fi) == -1)
+		{
+			/* file not found /**/
+			if (file != NULL)
+				SYSCOUNT(SC_CLOSE, fclose(file));
+			write_error(cp, RESP_NOT_FOUND);
+			write_to_log(cp->in.data, "404 Not Found", cp);
+			return;
+		}
+
+		/* Serve a pre-compressed sidecar if the client takes one /**/
+		file = request_negotiate(cp->in.data, dir, file, &fi);
+		/* Or a gzip copy made on the fly /**/
+		gz = request_compress(cp->in.data, dir, &fi);
+
+		/* Client copy is current, send the validators only /**/
+		if (request_not_modified(cp->in.data, &fi))
+		{
+			response_header(&cp->out, "304 Not Modified", NULL, -1,
+			    &fi, NULL);
+			if (set_write_content(cp) == 0)
+				write_to_log(cp->in.data, "304 Not Modified", 
+				    cp);
+			if (gz != NULL)
+				gzcache_put(gz);
+			SYSCOUNT(SC_CLOSE, fclose(file));
+			return;
+		}
+
+		/* HEAD request, send the header without reading the file /**/
+		if (cp->method == METHOD_HEAD)
+		{
+			response_header(&cp->out, "200 OK", NULL, fi.size, 
+			    &fi, NULL);
+			if (set_write_content(cp) == 0)
+				write_size_log(cp, "200 OK", 0, fi.size);
+			if (gz != NULL)
+				gzcache_put(gz);
+			SYSCOUNT(SC_CLOSE, fclose(file));
+			return;
+		}
+
+		/* Client asked for part of the file /**/
+		if (cp->method == METHOD_GET &&
+		    (ranges = request_range(cp->in.data, &fi, &rs)) != 0)
+		{
+			cp->hl = range_header(&rs, &fi, &cp->out);
+			if (ranges == -1)
+			{
+				if (set_write_content(cp) == 0)
+					write_to_log(cp->in.data, 
+					    "416 Range Not Satisfiable", cp);
+			}
+			else if (set_write_content(cp) == 0)
+			{
+				/* Sent from the file, kept until closed /**/
+				cp->file = file;
+				stream_ranges(cp, fileno(file), &rs);
+				return;
+			}
+			SYSCOUNT(SC_CLOSE, fclose(file));
+			return;
+		}
+
+		/*
+		 * OK request from the body cache. A body being loaded
+		 * for another connection is waited for, not read again.
+		 /**/
+		if (gz == NULL && (cp->doc = doccache_get(dir, &fi, 0)) != 
+		    NULL)
+		{
+			cp->hl = response_header(&cp->out, "200 OK", NULL, 
+			    fi.size, &fi, NULL);
+			if (set_write_content(cp) == -1)
+			{
+				doccache_put(cp->doc);
+				cp->doc = NULL;
+				SYSCOUNT(SC_CLOSE, fclose(file));
+				return;
+			}
+			cp->ok = 1;
+			cp->status = "200 OK";
+			cp->file = file;
+			if (doccache_state(cp->doc) == DC_LOADING)
+				set_state(cp, STATE_PARKED);
+			else
+				unpark(cp);
+			return;
+		}
+
+		/* OK request, the header goes first /**/
+		cp->hl = response_header(&cp->out, "200 OK", NULL, fi.size, 
+		    &fi, NULL);
+		if (set_write_content(cp) == -1)
+		{
+			if (gz != NULL)
+				gzcache_put(gz);
+			SYSCOUNT(SC_CLOSE, fclose(file));
+			return;
+		}
+		cp->ok = 1;
+		cp->status = "200 OK";
+		if (gz != NULL)
+		{
+			/* Written straight from the gzip copy /**/
+			cp->gz = gz;
+			cp->iov[1].iov_base = gz->data;
+			cp->iov[1].iov_len = fi.size;
+			cp->iovcnt = 2;
+			cp->bl += fi.size;
+			cp->bs = cp->bl;
+		}
+		else if (!memory_pressure() && 
+		    buf_reserve(&cp->out, fi.size) == 0)
+		{
+			/* Read in after the header, short reads are logged /**/
+			cp->out.len += SYSBYTES(SC_FILE, fread(cp->out.data + 
+			    cp->out.len, 1, fi.size, file));
+			set_write_content(cp);
+			cp->bs = cp->hl + fi.size;
+		}
+		else
+		{
+			/* No memory for the body, send it from the file /**/
+			stream_file(cp, file, fi.size);
+			return;
+		}
+		SYSCOUNT(SC_CLOSE, fclose(file));
+	}
+}
+
+/*
+ * Answer a request for path from the current snapshot: 304, 206, 416 or
+ * a 200 whose iovecs point into the mapped archive, which the connection
+ * holds until closed. Returns -1 if there is no snapshot or it doesn't
+ * hold path.
+ /**/
+static int read_snapshot(struct connectiondata *cp, const char *path)
+{
+	const struct snapentry *e;
+	struct fileinfo fi;
+	struct rangeset rs;
+	size_t len;
+	int ranges;
+
+	if ((cp->snap = snapshot_get()) == NULL)
+		return -1;
+	if ((e = request_snapshot(cp->in.data, cp->snap, path, &fi)) == NULL)
+	{
+		snapshot_put(cp->snap);
+		cp->snap = NULL;
+		return -1;
+	}
+
+	if (request_not_modified(cp->in.data, &fi))
+	{
+		response_header(&cp->out, "304 Not Modified", NULL, -1, &fi, 
+		    NULL);
+		if (set_write_content(cp) == 0)
+			write_to_log(cp->in.data, "304 Not Modified", cp);
+	}
+	else if (cp->method == METHOD_GET &&
+	    (ranges = request_range(cp->in.data, &fi, &rs)) != 0)
+	{
+		cp->hl = range_header(&rs, &fi, &cp->out);
+		if (ranges == -1)
+		{
+			if (set_write_content(cp) == 0)
+				write_to_log(cp->in.data, 
+				    "416 Range Not Satisfiable", cp);
+		}
+		else if (set_write_content(cp) == 0)
+		{
+			/* Ranges are sent from the archive at the body /**/
+			rs.base = e->v[fi.encoding].body;
+			stream_ranges(cp, cp->snap->fd, &rs);
+		}
+	}
+	else
+	{
+		/* Written from the archive, only the Date is copied /**/
+		len = snapshot_iov(cp->snap, e, fi.encoding, cp->iov);
+		memcpy(cp->date, cp->iov[1].iov_base, cp->iov[1].iov_len);
+		cp->iov[1].iov_base = cp->date;
+		cp->iovcnt = SNAP_IOVCNT;
+		cp->bl = len;
+		cp->hl = len - fi.size;
+		cp->bs = len;
+		if (cp->method == METHOD_HEAD)
+		{
+			cp->iovcnt--;
+			cp->bl -= fi.size;
+			write_size_log(cp, "200 OK", 0, fi.size);
+		}
+		else
+		{
+			cp->ok = 1;
+			cp->status = "200 OK";
+		}
+	}
+	return 0;
+}
+
+/*
+ * Queue the body of a 200 OK after its header once the body cache is
+ * done loading it. The file is read here if the load failed.
+ /**/
+static void unpark(struct connectiondata *cp)
+{
+	size_t size;
+
+	size = cp->doc->size;
+	set_state(cp, STATE_WRITING);
+	cp->bs = cp->hl + size;
+	if (doccache_state(cp->doc) == DC_READY)
+	{
+		/* Written straight from the cache /**/
+		cp->iov[cp->iovcnt].iov_base = cp->doc->data;
+		cp->iov[cp->iovcnt].iov_len = size;
+		cp->iovcnt++;
+		cp->bl += size;
+	}
+	else if (!memory_pressure() && buf_reserve(&cp->out, size) == 0)
+	{
+		/* Short reads are logged as a short write /**/
+		cp->out.len += SYSBYTES(SC_FILE, fread(cp->out.data + 
+		    cp->out.len, 1, size, cp->file));
+		cp->iov[0].iov_base = cp->out.data;
+		cp->iov[0].iov_len = cp->out.len;
+		cp->bl = cp->out.len;
+	}
+	else
+	{
+		/* No memory for the body, send it from the file /**/
+		stream_file(cp, cp->file, size);
+		return;
+	}
+	SYSCOUNT(SC_CLOSE, fclose(cp->file));
+	cp->file = NULL;
+}
+
+/*
+ * Queue the response built in the output buffer, -1 if it couldn't be
+ * for want of memory and a 503 was queued instead. Nothing was built
+ * when the header didn't fit whole.
+ /**/
+static int set_write_content(struct connectiondata *cp)
+{
+	if (cp->out.len == 0)
+	{
+		write_error(cp, RESP_SERVICE_UNAVAILABLE);
+		write_to_log(cp->in.data, "503 Service Unavailable", cp);
+		return -1;
+	}
+	cp->bs = cp->out.len;
+	cp->bl = cp->bs;
+	cp->iov[0].iov_base = cp->out.data;
+	cp->iov[0].iov_len = cp->bl;
+	cp->iovcnt = 1;
+	return 0;
+}
+
+/*
+ * Send the size byte body of the queued header from file with
+ * sendfile(), which the connection holds until closed, instead of
+ * reading it into memory.
+ /**/
+static void stream_file(struct connectiondata *cp, FILE *file, 
+    size_t size)
+{
+	cp->file = file;
+	cp->fd = fileno(file);
+	cp->foff = 0;
+	cp->fl = size;
+	cp->bl += size;
+	cp->bs = cp->hl + size;
+	memory_streamed();
+}
+
+/*
+ * Send the 206 body of rs after the queued header with sendfile() from
+ * fd, which stays open until the connection closes. Only the delimiter
+ * of the part being sent is held in memory, never the ranges.
+ /**/
+static void stream_ranges(struct connectiondata *cp, int fd, 
+    const struct rangeset *rs)
+{
+	cp->fd = fd;
+	cp->rs = *rs;
+	cp->part = 0;
+	cp->bl += rs->length;
+	cp->bs = cp->hl + rs->length;
+	cp->ok = 1;
+	cp->status = "206 Partial Content";
+	queue_part(cp);
+}
+
+/*
+ * Queue the next part of a range body: its delimiter when there are
+ * several, then its bytes from the file, or the closing delimiter.
+ /**/
+static void queue_part(struct connectiondata *cp)
+{
+	struct rangeset *rs = &cp->rs;
+	struct range *r;
+
+	if (rs->count > 1)
+	{
+		cp->iov[cp->iovcnt].iov_base = cp->delim;
+		cp->iov[cp->iovcnt].iov_len = range_part(rs, cp->part, 
+		    cp->delim, sizeof(cp->delim));
+		cp->iovcnt++;
+	}
+	if (cp->part < rs->count)
+	{
+		r = &rs->r[cp->part];
+		cp->foff = rs->base + r->first;
+		cp->fl = r->last - r->first + 1;
+	}
+	cp->part++;
+}
+
+/* Make a free connection /**/
+static struct connectiondata * get_free_conn(void)
+{
+	int i;
+	for (i = 0; i < nconnections; i++) {
+		if (connections[i].state == STATE_UNUSED)
+			return(&connections[i]);
+	}
+	return(NULL);
+}
+
+/* Take a connection off the parked list /**/
+static void unlink_parked(struct connectiondata *cp)
+{
+	if (cp->pprev != NULL)
+		cp->pprev->pnext = cp->pnext;
+	else
+		parked = cp->pnext;
+	if (cp->pnext != NULL)
+		cp->pnext->pprev = cp->pprev;
+}
+
+/* Close or initialize a connection /**/
+static void closecon(struct connectiondata *cp, int initflag)
+{
+	if (!initflag) {
+		if (cp->sd != -1) {
+			poller_set(cp->sd, 0, NULL);
+			SYSCOUNT(SC_CLOSE, close(cp->sd));
+			admission_leave();
+			admission_latency(&cp->start);
+			ratelimit_leave(cp->sa.sin_addr.s_addr);
+		}
+		buf_free(&cp->in);
+		buf_free(&cp->out);
+		if (cp->doc != NULL)
+			doccache_put(cp->doc);
+		if (cp->gz != NULL)
+			gzcache_put(cp->gz);
+		if (cp->file != NULL)
+			SYSCOUNT(SC_CLOSE, fclose(cp->file));
+		if (cp->snap != NULL)
+			snapshot_put(cp->snap);
+		if (cp->state == STATE_PARKED)
+			unlink_parked(cp);
+		nstates[cp->state]--;
+		/* Every call for it is counted now, the close too /**/
+		syscount_close(&cp->sc);
+	}
+	nstates[STATE_UNUSED]++;
+	memset(cp, 0, sizeof(struct connectiondata));
+	buf_init(&cp->in, NULL, 0);
+	buf_init(&cp->out, NULL, 0);
+	cp->sd = -1;
+}
+
+/* Log a request of the connection /**/
+static void write_to_log(const char *getline, const char *completion, 
+    struct connectiondata *cp)
+{
+	logfile_write(cp->logfile, getline, completion, cp->ip);
+}
+
+/* Log a response with sent of its size body bytes written /**/
+static void write_size_log(struct connectiondata *cp, const char *status,
+    off_t sent, off_t size)
+{
+	char msg[HDR_SIZE];
+
+	snprintf(msg, sizeof(msg), "%s %lld/%lld", status, (long long)sent,
+	    (long long)size);
+	write_to_log(cp->in.data, msg, cp);
+}
+
+/* Write OK message to log /**/
+static void write_OK_log(struct connectiondata *cp)
+{
+	write_size_log(cp, cp->status, cp->w - cp->hl, cp->bs - cp->hl);
+}
+
+/*
+ * Point the connection at a canned error response. Only the Date is
+ * copied, so the pending write survives the cached Date changing.
+ /**/
+static void write_error(struct connectiondata *cp, int resp)
+{
+	cp->bl = response_iov(resp, cp->iov);
+	memcpy(cp->date, cp->iov[1].iov_base, cp->iov[1].iov_len);
+	cp->iov[1].iov_base = cp->date;
+	cp->iovcnt = RESP_IOVCNT;
+}
@@ -0,0 +1,363 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Copyright (c) 2008 Bob Beck <beck@obtuse.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+/*
+ * Process engines: fork a child process to service each connection, or
+ * prefork a few processes that each accept and service one at a time.
+ *
+ * Compile using 'gcc -c engine_fork.c' and link it into the server.
+ */
+
+/* accept4() /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "core.h"
+#include "engine.h"
+#include "hotpath.h"
+#include "listener.h"
+#include "memory.h"
+#include "ratelimit.h"
+#include "response.h"
+#include "snapshot.h"
+#include "syscount.h"
+#include "transmit.h"
+
+/* Function Prototypes /**/
+static void handle_child(int);
+static void reap_children(void);
+static void handle_tick(int);
+static void add_child(pid_t, in_addr_t);
+
+/* Client of each child, counted out of its limits when it is reaped /**/
+struct child
+{
+	pid_t pid;			/* 0 if the slot is free /**/
+	in_addr_t addr;
+};
+static struct child *children;
+static int nchildren;
+static size_t stack;			/* charged for each child /**/
+static volatile sig_atomic_t reap;	/* set when a child is done /**/
+
+/* Fork engine: accept in this process, serve each client in a child /**/
+void fork_run(struct engineconf *c)
+{
+	struct sockaddr_in client;
+	struct sigaction sa;
+	struct timespec start;
+	socklen_t clientlen;
+	pid_t pid;
+	int clientsd, ready, reason;
+	char client_ip[PEER_SIZE];
+
+	/*
+	 * Children count themselves in and the parent counts them out.
+	 * The children table has room for as many as may be in flight.
+	 /**/
+	engine_setup(c, -1);
+	stack = c->stack;
+	nchildren = c->maxinflight;
+	if ((children = calloc(nchildren, sizeof(*children))) == NULL)
+		err(1, "can't allocate children table");
+
+	/*
+	 * Handler for child processes. Without SA_RESTART it interrupts
+	 * accept() and poll() so the loop reaps while no client comes.
+	 /**/
+	sa.sa_handler = handle_child;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if (sigaction(SIGCHLD, &sa, NULL) == -1)
+		err(1, "sigaction failed");
+	/* SIGHUP must interrupt accept() /**/
+	sigprocmask(SIG_UNBLOCK, &c->hup, NULL);
+
+	/* Start listening for connections /**/
+	while (1)
+	{
+		/* Reload the snapshot, dump the hot paths if signalled /**/
+		engine_signalled();
+		/*
+		 * Leave clients queued while memory is short. Only reaping
+		 * gives the children's stacks back, so reap while waiting.
+		 /**/
+		reap_children();
+		if (memory_pressure())
+		{
+			memory_paused();
+			do
+			{
+				poll(NULL, 0, MEM_WAIT_MS);
+				reap_children();
+			} while (memory_pressure());
+		}
+		if ((ready = listener_ready(c->sd, c->usd)) == -1)
+			continue;
+		/*
+		 * Unix domain clients have no address and no rate limit.
+		 * Without usd nothing was polled, so accept() waits idle.
+		 /**/
+		memset(&client, 0, sizeof(client));
+		clientlen = sizeof(client);
+		if (ready == c->usd)
+			clientsd = SYSCOUNT(SC_ACCEPT, accept(c->usd, NULL, 
+			    NULL));
+		else
+			clientsd = SYSCOUNT(c->usd == -1 ? SC_IDLE : 
+			    SC_ACCEPT, accept(c->sd, 
+			    (struct sockaddr *)&client, &clientlen));
+		if (clientsd == -1 && errno == EINTR)
+			continue;
+		if (clientsd == -1)
+			err(1, "accept failed");
+		/* A child may have finished while accept() waited /**/
+		reap_children();
+
+		/* Over a limit, refuse before forking /**/
+		if (admission_check(c->sd) != ADMIT_OK)
+		{
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		if ((reason = ratelimit_check(client.sin_addr.s_addr)) != 
+		    ADMIT_OK)
+		{
+			admission_leave();
+			admission_refused(reason);
+			admission_reject(clientsd, RESP_TOO_MANY_REQUESTS);
+			continue;
+		}
+		/* A child's stack is charged until it is reaped /**/
+		if (memory_take(MEM_STACKS, stack) == -1)
+		{
+			ratelimit_leave(client.sin_addr.s_addr);
+			admission_leave();
+			admission_refused(ADMIT_MEMORY);
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pid = fork();
+		if (pid == -1)
+			err(1, "fork failed");
+		if (pid == 0)
+		{
+			if (ready == c->usd)
+				listener_peer(clientsd, client_ip, 
+				    sizeof(client_ip));
+			else
+				inet_ntop(AF_INET, &client.sin_addr, 
+				    client_ip, sizeof(client_ip));
+			transmit_open(clientsd);
+			core_serve(clientsd, client_ip, sizeof(client_ip));
+			transmit_close(clientsd);
+			admission_latency(&start);
+			/* What came after the log line is served by no one /**/
+			syscount_flush();
+			exit(0);
+		}
+		add_child(pid, client.sin_addr.s_addr);
+		SYSCOUNT(SC_CLOSE, close(clientsd));
+	}
+}
+
+/*
+ * Prefork engine: -w processes, one per CPU by default, each accepting
+ * on the listeners they share and serving the client itself. Counters
+ * and the document cache are shared, rate limits are per process.
+ /**/
+void prefork_run(struct engineconf *c)
+{
+	struct itimerval second = { { 1, 0 }, { 1, 0 } }, off = { 0 };
+	struct sockaddr_in client;
+	struct sigaction sa;
+	struct timespec start;
+	socklen_t clientlen;
+	int clientsd, ready, reason, ticking;
+	char client_ip[PEER_SIZE];
+
+	engine_setup(c, -1);
+	/*
+	 * Alone the port is waited on in accept(), which wakes one
+	 * process; with the Unix domain socket every process polls both
+	 * and those that lose the race find the queue empty.
+	 /**/
+	if (c->usd != -1 && (fcntl(c->sd, F_SETFL, fcntl(c->sd, F_GETFL) |
+	    O_NONBLOCK) == -1 || fcntl(c->usd, F_SETFL, fcntl(c->usd, 
+	    F_GETFL) | O_NONBLOCK) == -1))
+		err(1, "fcntl failed");
+	engine_spawn(c->workers, 0, &c->hup);
+	hotpath_worker();
+
+	/*
+	 * While it holds hot path counts a timer interrupts accept() each
+	 * second, like SIGHUP, so an idle process merges them too.
+	 /**/
+	sa.sa_handler = handle_tick;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if (sigaction(SIGALRM, &sa, NULL) == -1)
+		err(1, "sigaction failed");
+	sigaddset(&c->hup, SIGALRM);
+	sigprocmask(SIG_BLOCK, &c->hup, NULL);
+	ticking = 0;
+
+	while (1)
+	{
+		/* Reload the snapshot, dump the hot paths if signalled /**/
+		engine_signalled();
+		hotpath_tick();
+		if (hotpath_pending() != ticking)
+		{
+			ticking = !ticking;
+			setitimer(ITIMER_REAL, ticking ? &second : &off, NULL);
+		}
+		/* Leave clients queued while memory is short /**/
+		memory_wait();
+		memset(&client, 0, sizeof(client));
+		clientlen = sizeof(client);
+		sigprocmask(SIG_UNBLOCK, &c->hup, NULL);
+		/* Blocking without usd, so then accept() waits idle /**/
+		if ((ready = listener_ready(c->sd, c->usd)) == -1)
+			clientsd = -1;
+		else if (ready == c->usd)
+			clientsd = SYSCOUNT(SC_ACCEPT, accept4(c->usd, NULL, 
+			    NULL, SOCK_CLOEXEC));
+		else
+			clientsd = SYSCOUNT(c->usd == -1 ? SC_IDLE : 
+			    SC_ACCEPT, accept4(c->sd, 
+			    (struct sockaddr *)&client, &clientlen, 
+			    SOCK_CLOEXEC));
+		sigprocmask(SIG_BLOCK, &c->hup, NULL);
+		if (ready == -1)
+			continue;
+		if (clientsd == -1)
+		{
+			if (errno == EINTR || errno == EAGAIN || 
+			    errno == EWOULDBLOCK || errno == ECONNABORTED)
+				continue;
+			err(1, "accept failed");
+		}
+
+		/* Over a limit, refuse before reading anything /**/
+		if (admission_check(c->sd) != ADMIT_OK)
+		{
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		/* So is a client over its own limits /**/
+		if ((reason = ratelimit_check(client.sin_addr.s_addr)) != 
+		    ADMIT_OK)
+		{
+			admission_leave();
+			admission_refused(reason);
+			admission_reject(clientsd, RESP_TOO_MANY_REQUESTS);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (ready == c->usd)
+			listener_peer(clientsd, client_ip, sizeof(client_ip));
+		else
+			inet_ntop(AF_INET, &client.sin_addr, client_ip, 
+			    sizeof(client_ip));
+		transmit_open(clientsd);
+		core_serve(clientsd, client_ip, sizeof(client_ip));
+		transmit_close(clientsd);
+		SYSCOUNT(SC_CLOSE, close(clientsd));
+		admission_leave();
+		admission_latency(&start);
+		ratelimit_leave(client.sin_addr.s_addr);
+	}
+}
+
+/* Note that a child is done, the accept loop reaps it /**/
+static void handle_child(int signum)
+{
+	reap = 1;
+}
+
+/* Count every child that is done out of its limits /**/
+static void reap_children(void)
+{
+	pid_t pid;
+	int i;
+
+	if (!reap)
+		return;
+	reap = 0;
+	/* Signals merge, reap every child that is done /**/
+	while ((pid = waitpid(WAIT_ANY, NULL, WNOHANG)) > 0)
+	{
+		admission_leave();
+		memory_give(MEM_STACKS, stack);
+		for (i = 0; i < nchildren; i++)
+			if (children[i].pid == pid)
+			{
+				ratelimit_leave(children[i].addr);
+				children[i].pid = 0;
+				break;
+			}
+	}
+}
+
+/* Nothing to do, the timer only interrupts accept() /**/
+static void handle_tick(int signum)
+{
+}
+
+/* Remember the client of a child until it is reaped /**/
+static void add_child(pid_t pid, in_addr_t addr)
+{
+	int i;
+
+	for (i = 0; i < nchildren; i++)
+		if (children[i].pid == 0)
+		{
+			children[i].pid = pid;
+			children[i].addr = addr;
+			return;
+		}
+	/* Can't happen while -m is clamped, don't hold the client /**/
+	ratelimit_leave(addr);
+}
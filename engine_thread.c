@@ -0,0 +1,420 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Copyright (c) 2008 Bob Beck <beck@obtuse.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+/*
+ * Thread engines: service each connection in a new thread, or in a
+ * pool of worker threads fed by one acceptor thread through handoffs.
+ *
+ * Compile using 'gcc -c engine_thread.c' and link it into the server.
+ */
+
+/* accept4() /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "core.h"
+#include "engine.h"
+#include "handoff.h"
+#include "hotpath.h"
+#include "listener.h"
+#include "memory.h"
+#include "ratelimit.h"
+#include "response.h"
+#include "snapshot.h"
+#include "syscount.h"
+#include "transmit.h"
+
+/* Function prototypes /**/
+static void * handle_client(void *);
+static void accept_drain(int, int);
+static int  worker_take(long, struct handoffconn *);
+static void * worker(void *);
+
+/* A connection handed to its own thread /**/
+struct thread_data
+{
+	int clientsd;
+	struct in_addr addr;
+	char clientip[PEER_SIZE];
+	struct timespec start;
+};
+
+/* Stack charged for each thread of the thread engine /**/
+static size_t stack;
+
+/* The worker pool /**/
+static struct handoff *queues;		/* one per worker /**/
+static int nworkers;
+static int dist;
+
+/* Thread engine: accept on this thread, serve each client in a new one /**/
+void thread_run(struct engineconf *c)
+{
+	struct sockaddr_in client;
+	struct thread_data *td;
+	pthread_attr_t attr;
+	pthread_t thread;
+	socklen_t clientlen;
+	int clientsd, ready, reason;
+
+	engine_setup(c, -1);
+	stack = c->stack;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_attr_setstacksize(&attr, c->stack) != 0)
+		errx(1, "bad thread stack size %zu", c->stack);
+
+	/* Accept incoming client connections /**/
+	while (1)
+	{
+		/* Reload the snapshot, dump the hot paths if signalled /**/
+		pthread_sigmask(SIG_UNBLOCK, &c->hup, NULL);
+		engine_signalled();
+		/* Leave clients queued while memory is short /**/
+		memory_wait();
+
+		/* Accept client connection /**/
+		if ((ready = listener_ready(c->sd, c->usd)) == -1)
+		{
+			pthread_sigmask(SIG_BLOCK, &c->hup, NULL);
+			continue;
+		}
+		/*
+		 * Unix domain clients have no address and no rate limit.
+		 * Without usd nothing was polled, so accept() waits idle.
+		 /**/
+		memset(&client, 0, sizeof(client));
+		clientlen = sizeof(client);
+		if (ready == c->usd)
+			clientsd = SYSCOUNT(SC_ACCEPT, accept(c->usd, NULL, 
+			    NULL));
+		else
+			clientsd = SYSCOUNT(c->usd == -1 ? SC_IDLE : 
+			    SC_ACCEPT, accept(c->sd, 
+			    (struct sockaddr *)&client, &clientlen));
+		pthread_sigmask(SIG_BLOCK, &c->hup, NULL);
+		/* The acceptor serves no request itself /**/
+		syscount_flush();
+		if (clientsd == -1 && errno == EINTR)
+			continue;
+		if (clientsd == -1)
+			err(1, "accept failed");
+
+		/* Over a limit, refuse before reading anything /**/
+		if (admission_check(c->sd) != ADMIT_OK)
+		{
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		/* So is a client over its own limits /**/
+		if ((reason = ratelimit_check(client.sin_addr.s_addr)) != 
+		    ADMIT_OK)
+		{
+			admission_leave();
+			admission_refused(reason);
+			admission_reject(clientsd, RESP_TOO_MANY_REQUESTS);
+			continue;
+		}
+
+		/* The stack of its thread must fit the memory budget /**/
+		if (memory_take(MEM_STACKS, stack) == -1)
+		{
+			ratelimit_leave(client.sin_addr.s_addr);
+			admission_leave();
+			admission_refused(ADMIT_MEMORY);
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+
+		/* Initialize thread data /**/
+		if ((td = malloc(sizeof(*td))) != NULL)
+		{
+			td->clientsd = clientsd;
+			td->addr = client.sin_addr;
+			clock_gettime(CLOCK_MONOTONIC, &td->start);
+			if (ready == c->usd)
+				listener_peer(clientsd, td->clientip, 
+				    sizeof(td->clientip));
+			else
+				inet_ntop(AF_INET, &client.sin_addr, 
+				    td->clientip, sizeof(td->clientip));
+			transmit_open(clientsd);
+		}
+		/* Create posix thread to handle client, it cleans up /**/
+		if (td == NULL || 
+		    pthread_create(&thread, &attr, handle_client, td) != 0)
+		{
+			free(td);
+			memory_give(MEM_STACKS, stack);
+			ratelimit_leave(client.sin_addr.s_addr);
+			admission_leave();
+			admission_refused(ADMIT_INFLIGHT);
+			admission_reject(clientsd, RESP_SERVICE_UNAVAILABLE);
+		}
+	}
+}
+
+/* Serve the client of a thread of its own, then count it out /**/
+static void * handle_client(void *arg)
+{
+	struct thread_data *td = arg;
+
+	core_serve(td->clientsd, td->clientip, sizeof(td->clientip));
+	transmit_close(td->clientsd);
+	SYSCOUNT(SC_CLOSE, close(td->clientsd));
+	admission_leave();
+	admission_latency(&td->start);
+	ratelimit_leave(td->addr.s_addr);
+	syscount_flush();
+	free(td);
+	memory_give(MEM_STACKS, stack);
+	return NULL;
+}
+
+/*
+ * Worker pool engine: start -w threads, one per CPU by default, each
+ * with its own handoff, and accept on this thread alone. Never returns.
+ /**/
+void pool_run(struct engineconf *c)
+{
+	struct pollfd pfd[2];
+	pthread_attr_t attr;
+	pthread_t thread;
+	long i;
+	int n;
+
+	engine_setup(c, -1);
+	nworkers = c->workers;
+	dist = c->dist;
+	if ((queues = calloc(nworkers, sizeof(*queues))) == NULL)
+		err(1, "calloc failed");
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_attr_setstacksize(&attr, c->stack) != 0)
+		errx(1, "bad thread stack size %zu", c->stack);
+	for (i = 0; i < nworkers; i++)
+	{
+		handoff_init(&queues[i]);
+		if (pthread_create(&thread, &attr, worker, (void *)i) != 0)
+			err(1, "unable to create thread");
+		memory_charge(MEM_STACKS, c->stack);
+	}
+	pthread_attr_destroy(&attr);
+
+	n = 0;
+	pfd[n++].fd = c->sd;
+	if (c->usd != -1)
+		pfd[n++].fd = c->usd;
+	for (i = 0; i < n; i++)
+	{
+		pfd[i].events = POLLIN;
+		if (fcntl(pfd[i].fd, F_SETFL, fcntl(pfd[i].fd, F_GETFL) | 
+		    O_NONBLOCK) == -1)
+			err(1, "fcntl failed");
+	}
+	while (1)
+	{
+		/* Reload the snapshot, dump the hot paths if signalled /**/
+		pthread_sigmask(SIG_UNBLOCK, &c->hup, NULL);
+		engine_signalled();
+		/* Leave clients queued while memory is short /**/
+		memory_wait();
+		i = SYSCOUNT(SC_IDLE, poll(pfd, n, -1));
+		pthread_sigmask(SIG_BLOCK, &c->hup, NULL);
+		if (i == -1 && errno != EINTR)
+			err(1, "poll failed");
+		for (i = 0; i < n; i++)
+			if (pfd[i].revents & POLLIN)
+				accept_drain(pfd[i].fd, pfd[i].fd == c->usd);
+		/* The acceptor serves no request itself /**/
+		syscount_flush();
+	}
+}
+
+/*
+ * Drain the backlog of listening socket sd with accept4() until EAGAIN
+ * and push each admitted connection to a worker as dist says, then wake
+ * a sleeping worker that may take it. local is set for the Unix domain
+ * socket, whose clients have no address.
+ /**/
+static void accept_drain(int sd, int local)
+{
+	static int next;
+	struct handoffconn c;
+	struct sockaddr_in client;
+	socklen_t clientlen;
+	unsigned int load, best;
+	int i, w, reason;
+
+	while (1)
+	{
+		memset(&client, 0, sizeof(client));
+		clientlen = sizeof(client);
+		c.sd = SYSCOUNT(SC_ACCEPT, accept4(sd, local ? NULL : 
+		    (struct sockaddr *)&client, local ? NULL : &clientlen, 
+		    SOCK_CLOEXEC));
+		if (c.sd == -1)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+			err(1, "accept failed");
+		}
+
+		/* Over a limit, refuse before handing off /**/
+		if (admission_check(sd) != ADMIT_OK)
+		{
+			admission_reject(c.sd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+		if ((reason = ratelimit_check(client.sin_addr.s_addr)) !=
+		    ADMIT_OK)
+		{
+			admission_leave();
+			admission_refused(reason);
+			admission_reject(c.sd, RESP_TOO_MANY_REQUESTS);
+			continue;
+		}
+		c.addr = client.sin_addr;
+		c.local = local;
+		clock_gettime(CLOCK_MONOTONIC, &c.start);
+
+		/* Pick a worker, scanning on from the last one /**/
+		w = dist == DIST_SHARED ? 0 : next;
+		if (dist == DIST_LEAST)
+		{
+			best = UINT_MAX;
+			for (i = 0; i < nworkers && best > 0; i++)
+			{
+				load = handoff_load(
+				    &queues[(next + i) % nworkers]);
+				if (load < best)
+				{
+					best = load;
+					w = (next + i) % nworkers;
+				}
+			}
+		}
+		next = (w + 1) % nworkers;
+
+		/* Every queue full, refuse like any other overload /**/
+		for (i = 0; i < nworkers; i++)
+		{
+			if (handoff_push(&queues[w], &c) == 0)
+				break;
+			if (dist == DIST_SHARED)
+				i = nworkers - 1;
+			else
+				w = (w + 1) % nworkers;
+		}
+		if (i == nworkers)
+		{
+			ratelimit_leave(c.addr.s_addr);
+			admission_leave();
+			admission_refused(ADMIT_INFLIGHT);
+			admission_reject(c.sd, RESP_SERVICE_UNAVAILABLE);
+			continue;
+		}
+
+		/*
+		 * Only the owner takes from its queue with rr and least;
+		 * from the shared one any sleeper will do.
+		 /**/
+		if (handoff_wake(&queues[w]) || dist != DIST_SHARED)
+			continue;
+		for (i = 1; i < nworkers; i++)
+			if (handoff_wake(&queues[(w + i) % nworkers]))
+				break;
+	}
+}
+
+/* Take the next connection for worker self, -1 if there is none /**/
+static int worker_take(long self, struct handoffconn *c)
+{
+	return handoff_take(&queues[dist == DIST_SHARED ? 0 : self], c);
+}
+
+/* Serve the connections of one worker of the pool, forever /**/
+static void * worker(void *arg)
+{
+	struct handoff *h;
+	struct handoffconn c;
+	char clientip[PEER_SIZE];
+	long self;
+
+	self = (long)arg;
+	h = &queues[self];
+	hotpath_worker();
+	while (1)
+	{
+		/* Look once more after saying so before going to sleep /**/
+		if (worker_take(self, &c) == -1)
+		{
+			handoff_idle(h);
+			if (worker_take(self, &c) == -1)
+			{
+				/* Merge hot path counts before sleeping /**/
+				hotpath_flush();
+				handoff_wait(h);
+				continue;
+			}
+			handoff_awake(h);
+		}
+		handoff_busy(h, 1);
+		if (c.local)
+			listener_peer(c.sd, clientip, sizeof(clientip));
+		else
+			inet_ntop(AF_INET, &c.addr, clientip, 
+			    sizeof(clientip));
+		transmit_open(c.sd);
+		core_serve(c.sd, clientip, sizeof(clientip));
+		transmit_close(c.sd);
+		SYSCOUNT(SC_CLOSE, close(c.sd));
+		admission_leave();
+		admission_latency(&c.start);
+		ratelimit_leave(c.addr.s_addr);
+		handoff_busy(h, 0);
+	}
+	return NULL;
+}
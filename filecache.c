@@ -0,0 +1,186 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-file validator cache.
+ *
+ * Compile using 'gcc -c filecache.c' and link filecache.o into each
+ * server (threads need -lpthread).
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "encoding.h"
+#include "filecache.h"
+#include "response.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define FC_SLOTS 1024
+#define FC_PATH 256
+#define FC_RECHECK 60
+
+struct fcentry
+{
+	char path[FC_PATH];	/* document path, empty if slot unused /**/
+	struct fileinfo fi;	/* cached validators /**/
+	time_t probed;		/* when the sidecars were last looked for /**/
+};
+
+static struct fcentry table[FC_SLOTS];
+static pthread_mutex_t fclock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+/* FNV-1a hash of a path /**/
+static unsigned int fc_hash(const char *path)
+{
+	unsigned int h = 2166136261u;
+
+	while (*path != '\0')
+	{
+		h ^= (unsigned char)*path++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * Look for fresh pre-compressed sidecars of path, ie) path.gz no older
+ * than the file itself, and return them as a mask of codings.
+ /**/
+static int fc_probe(const char *path, time_t mtime)
+{
+	char sidecar[FC_PATH + 8];
+	struct stat st;
+	int enc, mask;
+
+	mask = 0;
+	if (encoding_suffixed(path) != ENC_IDENTITY)
+		return mask;
+	for (enc = ENC_IDENTITY + 1; enc < ENC_COUNT; enc++)
+	{
+		snprintf(sidecar, sizeof(sidecar), "%s%s", path, 
+		    encoding_suffix(enc));
+		if (SYSCOUNT(SC_OPEN, stat(sidecar, &st)) == 0 && 
+		    S_ISREG(st.st_mode) &&
+		    st.st_mtime >= mtime)
+			mask |= ENC_BIT(enc);
+	}
+	return mask;
+}
+
+/* Render the validators of a file from its stat data /**/
+static void fc_render(struct fileinfo *fi, struct stat *st, 
+    const char *path)
+{
+	struct tm tm;
+
+	fi->dev = st->st_dev;
+	fi->ino = st->st_ino;
+	fi->size = st->st_size;
+	fi->mtime = st->st_mtime;
+	snprintf(fi->etag, sizeof(fi->etag), "\"%llx-%llx-%llx\"",
+	    (unsigned long long)st->st_ino, (unsigned long long)st->st_size,
+	    (unsigned long long)st->st_mtime);
+	strftime(fi->lastmod, sizeof(fi->lastmod), 
+	    "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&st->st_mtime, &tm));
+	fi->type = response_type(path);
+	fi->encoding = ENC_IDENTITY;
+	fi->encodings = 0;
+}
+
+/*
+ * Fill fi for the open file fd found at path. Validators are taken from
+ * the cache when the file is unchanged, otherwise rendered and stored.
+ * Returns -1 if fd can't be stat'd or is not a regular file.
+ /**/
+int filecache_stat(const char *path, int fd, struct fileinfo *fi)
+{
+	struct fcentry *e;
+	struct stat st;
+	time_t now;
+
+	if (SYSCOUNT(SC_OPEN, fstat(fd, &st)) == -1 || 
+	    !S_ISREG(st.st_mode))
+		return -1;
+	/* Paths too long for a slot are rendered every time /**/
+	if (strlen(path) >= FC_PATH)
+	{
+		fc_render(fi, &st, path);
+		return 0;
+	}
+
+	now = time(NULL);
+	e = &table[fc_hash(path) % FC_SLOTS];
+	pthread_mutex_lock(&fclock);
+	if (strcmp(e->path, path) != 0 || e->fi.dev != st.st_dev ||
+	    e->fi.ino != st.st_ino || e->fi.size != st.st_size ||
+	    e->fi.mtime != st.st_mtime)
+	{
+		strlcpy(e->path, path, sizeof(e->path));
+		fc_render(&e->fi, &st, path);
+		e->probed = 0;
+	}
+	/* Sidecars can appear without the file changing, look again /**/
+	if (now - e->probed >= FC_RECHECK)
+	{
+		e->fi.encodings = fc_probe(path, st.st_mtime);
+		e->probed = now;
+	}
+	memcpy(fi, &e->fi, sizeof(*fi));
+	pthread_mutex_unlock(&fclock);
+	return 0;
+}
+
+/*
+ * Open the sidecar of path holding coding enc and describe it in fi,
+ * which holds the file's own info on entry. The sidecar keeps the
+ * file's Content-Type and list of codings. Returns NULL, leaving fi
+ * alone, if the sidecar can't be used.
+ /**/
+FILE * filecache_open_encoded(const char *path, int enc, 
+    struct fileinfo *fi)
+{
+	char sidecar[FC_PATH + 8];
+	struct fileinfo efi;
+	FILE *file;
+
+	if (snprintf(sidecar, sizeof(sidecar), "%s%s", path, 
+	    encoding_suffix(enc)) >= sizeof(sidecar))
+		return NULL;
+	if ((file = SYSCOUNT(SC_OPEN, fopen(sidecar, "r"))) == NULL)
+		return NULL;
+	if (filecache_stat(sidecar, fileno(file), &efi) == -1 ||
+	    efi.mtime < fi->mtime)
+	{
+		SYSCOUNT(SC_CLOSE, fclose(file));
+		return NULL;
+	}
+	efi.type = fi->type;
+	efi.encoding = enc;
+	efi.encodings = fi->encodings;
+	memcpy(fi, &efi, sizeof(*fi));
+	return file;
+}
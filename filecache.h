@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-file validator cache shared by every server engine.
+ *
+ * The ETag and Last-Modified strings of a document are rendered the
+ * first time it is served and reused until its inode, size or mtime
+ * change, so a request only costs one fstat() to validate. The entry
+ * also remembers which pre-compressed sidecars the document has, so
+ * negotiating Accept-Encoding doesn't probe the disk per request.
+ */
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Defined Variables /**/
+#define FC_ETAG_SIZE 64
+#define FC_DATE_SIZE 40
+
+struct fileinfo
+{
+	dev_t dev;			/* device of the file /**/
+	ino_t ino;			/* inode of the file /**/
+	off_t size;			/* length of the file /**/
+	time_t mtime;			/* last modification time /**/
+	char etag[FC_ETAG_SIZE];	/* quoted entity tag /**/
+	char lastmod[FC_DATE_SIZE];	/* Last-Modified date /**/
+	const char *type;		/* Content-Type /**/
+	int encoding;			/* Content-Encoding of this file /**/
+	int encodings;			/* mask of fresh sidecar codings /**/
+};
+
+int    filecache_stat(const char *, int, struct fileinfo *);
+FILE * filecache_open_encoded(const char *, int, struct fileinfo *);
+
+#endif /* FILECACHE_H */
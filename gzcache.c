@@ -0,0 +1,317 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cache of gzip compressed documents.
+ *
+ * Compile using 'gcc -c gzcache.c' and link gzcache.o into a server
+ * with -lz -lpthread.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "encoding.h"
+#include "filecache.h"
+#include "gzcache.h"
+#include "lrucache.h"
+#include "memory.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define GZ_PENDING 0
+#define GZ_READY 1
+#define GZ_SKIP 2
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+static void gz_drop(struct lrunode *);
+
+static struct lrucache cache;
+static struct gzentry *queue_head, *queue_tail;
+static pthread_mutex_t gzlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gzwork = PTHREAD_COND_INITIALIZER;
+static size_t gz_budget;		/* bytes of compressed copies /**/
+static int gz_level;
+
+/* Free an entry nobody uses any more, giving back what it held /**/
+static void gz_free(struct gzentry *e)
+{
+	if (e->state == GZ_READY)
+		memory_give(MEM_CACHES, e->len);
+	memory_give(MEM_CACHES, sizeof(*e));
+	free(e->node.key);
+	free(e->data);
+	free(e);
+}
+
+/* Drop an entry from the cache, freeing it once unused. Hold gzlock. /**/
+static void gz_drop(struct lrunode *n)
+{
+	struct gzentry *e = (struct gzentry *)n;
+
+	lru_remove(&cache, n);
+	e->dead = 1;
+	if (e->refs == 0)
+		gz_free(e);
+}
+
+/*
+ * Compress the document of e into e->data. Returns -1 if the file
+ * changed since it was queued or does not shrink by at least a tenth,
+ * the entry then stays as a GZ_SKIP marker so it isn't tried again.
+ /**/
+static int gz_compress(struct gzentry *e)
+{
+	struct stat st;
+	z_stream zs;
+	char *in, *out;
+	size_t bound;
+	off_t got;
+	ssize_t r;
+	int fd, rc;
+
+	if ((fd = SYSCOUNT(SC_OPEN, open(e->node.key, O_RDONLY))) == -1)
+		return -1;
+	if (SYSCOUNT(SC_OPEN, fstat(fd, &st)) == -1 || st.st_ino != e->ino || 
+	    st.st_size != e->size || st.st_mtime != e->mtime ||
+	    (in = malloc(e->size)) == NULL)
+	{
+		SYSCOUNT(SC_CLOSE, close(fd));
+		return -1;
+	}
+	for (got = 0; got < e->size; got += r)
+	{
+		r = SYSBYTES(SC_FILE, pread(fd, in + got, e->size - got, 
+		    got));
+		if (r == -1 && errno == EINTR)
+			r = 0;
+		else if (r <= 0)
+			break;
+	}
+	SYSCOUNT(SC_CLOSE, close(fd));
+	if (got != e->size)
+	{
+		free(in);
+		return -1;
+	}
+
+	/* gzip wrapper is windowBits + 16 /**/
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, gz_level, Z_DEFLATED, 15 + 16, 8, 
+	    Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free(in);
+		return -1;
+	}
+	bound = deflateBound(&zs, e->size);
+	if ((out = malloc(bound)) == NULL)
+	{
+		deflateEnd(&zs);
+		free(in);
+		return -1;
+	}
+	zs.next_in = (Bytef *)in;
+	zs.avail_in = e->size;
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = bound;
+	rc = deflate(&zs, Z_FINISH);
+	deflateEnd(&zs);
+	free(in);
+	if (rc != Z_STREAM_END || zs.total_out >= e->size - e->size / 10)
+	{
+		free(out);
+		return -1;
+	}
+	e->len = zs.total_out;
+	e->data = realloc(out, e->len);
+	if (e->data == NULL)
+		e->data = out;
+	return 0;
+}
+
+/* Compression worker, takes queued documents until the server exits /**/
+static void * gz_worker(void *arg)
+{
+	struct gzentry *e;
+	int rc;
+
+	while (1)
+	{
+		pthread_mutex_lock(&gzlock);
+		while (queue_head == NULL)
+			pthread_cond_wait(&gzwork, &gzlock);
+		e = queue_head;
+		queue_head = e->qnext;
+		if (queue_head == NULL)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&gzlock);
+
+		rc = gz_compress(e);
+		syscount_flush();
+
+		pthread_mutex_lock(&gzlock);
+		e->refs--;
+		if (e->dead)
+		{
+			if (e->refs == 0)
+				gz_free(e);
+		}
+		else if (rc == -1)
+			e->state = GZ_SKIP;
+		/* Over the memory budget, a later request queues it again /**/
+		else if (memory_take(MEM_CACHES, e->len) == -1)
+			gz_drop(&e->node);
+		else
+		{
+			e->state = GZ_READY;
+			lru_charge(&cache, &e->node, e->len);
+			lru_evict(&cache, gz_budget, &e->node);
+		}
+		pthread_mutex_unlock(&gzlock);
+	}
+	return NULL;
+}
+
+/*
+ * Start the compression workers at gzip level, keeping budget bytes of
+ * compressed copies. Level 0 leaves compression off.
+ /**/
+void gzcache_init(int level, size_t budget)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int i;
+
+	cache.drop = gz_drop;
+	if (level <= 0)
+		return;
+	gz_budget = budget;
+	gz_level = level > 9 ? 9 : level;
+	memory_shrinker(gzcache_shrink);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for (i = 0; i < GZ_WORKERS; i++)
+		if (pthread_create(&thread, &attr, gz_worker, NULL) != 0)
+			err(1, "unable to create compression thread");
+	pthread_attr_destroy(&attr);
+}
+
+/* Check if a document may be compressed on the fly at all /**/
+int gzcache_eligible(const struct fileinfo *fi)
+{
+	if (gz_level == 0 || fi->encoding != ENC_IDENTITY || 
+	    fi->size < GZ_MIN || fi->size > GZ_MAX)
+		return 0;
+	/* Media and archives are compressed already /**/
+	return strncmp(fi->type, "text/", 5) == 0 || 
+	    strstr(fi->type, "javascript") != NULL ||
+	    strstr(fi->type, "json") != NULL || 
+	    strstr(fi->type, "xml") != NULL;
+}
+
+/*
+ * Return the gzip copy of the document at path described by fi, held
+ * for the caller until gzcache_put(). Returns NULL if there is no copy
+ * yet, after queueing one to be made if needed.
+ /**/
+struct gzentry * gzcache_get(const char *path, const struct fileinfo *fi)
+{
+	struct gzentry *e;
+	size_t len;
+
+	pthread_mutex_lock(&gzlock);
+	e = (struct gzentry *)lru_find(&cache, path);
+	/* Drop copies of an older version of the file /**/
+	if (e != NULL && (e->dev != fi->dev || e->ino != fi->ino || 
+	    e->size != fi->size || e->mtime != fi->mtime))
+	{
+		gz_drop(&e->node);
+		e = NULL;
+	}
+	if (e != NULL)
+	{
+		if (e->state != GZ_READY)
+			e = NULL;
+		else
+		{
+			e->refs++;
+			lru_touch(&cache, &e->node);
+		}
+		pthread_mutex_unlock(&gzlock);
+		return e;
+	}
+
+	/* Not seen before, queue it for the workers /**/
+	if ((e = calloc(1, sizeof(*e))) == NULL || 
+	    (e->node.key = strdup(path)) == NULL)
+	{
+		free(e);
+		pthread_mutex_unlock(&gzlock);
+		return NULL;
+	}
+	e->dev = fi->dev;
+	e->ino = fi->ino;
+	e->size = fi->size;
+	e->mtime = fi->mtime;
+	e->state = GZ_PENDING;
+	e->refs = 1;
+	/* Same tag as the file with -gz before the closing quote /**/
+	strlcpy(e->etag, fi->etag, sizeof(e->etag));
+	len = strlen(e->etag);
+	if (len > 1 && len + 3 < sizeof(e->etag))
+		strlcpy(e->etag + len - 1, "-gz\"", sizeof(e->etag) - len + 1);
+	e->node.bytes = sizeof(*e);
+	lru_insert(&cache, &e->node);
+	memory_charge(MEM_CACHES, sizeof(*e));
+	lru_evict(&cache, gz_budget, &e->node);
+	if (queue_tail != NULL)
+		queue_tail->qnext = e;
+	else
+		queue_head = e;
+	queue_tail = e;
+	pthread_cond_signal(&gzwork);
+	pthread_mutex_unlock(&gzlock);
+	return NULL;
+}
+
+/* Release a copy returned by gzcache_get() /**/
+void gzcache_put(struct gzentry *e)
+{
+	pthread_mutex_lock(&gzlock);
+	e->refs--;
+	if (e->dead && e->refs == 0)
+		gz_free(e);
+	pthread_mutex_unlock(&gzlock);
+}
+
+/* Drop the least recently used half of the compressed bytes /**/
+void gzcache_shrink(void)
+{
+	pthread_mutex_lock(&gzlock);
+	lru_evict(&cache, cache.bytes / 2, NULL);
+	pthread_mutex_unlock(&gzlock);
+}
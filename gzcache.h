@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cache of gzip compressed documents, made on the fly.
+ *
+ * Documents without a pre-compressed sidecar can be sent gzip'd to
+ * clients that accept it. The first request for a file version only
+ * queues it for the compression workers and is answered uncompressed;
+ * once a worker has made the copy, later requests are served from the
+ * cache until the file changes or the copy is evicted. Compression
+ * never runs on a server's request path.
+ */
+
+#ifndef GZCACHE_H
+#define GZCACHE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "filecache.h"
+#include "lrucache.h"
+
+/* Defined Variables /**/
+#define GZ_MIN 1024			/* smallest body worth compressing /**/
+#define GZ_MAX (16 * 1024 * 1024)	/* largest body compressed /**/
+#define GZ_WORKERS 2
+
+struct gzentry
+{
+	struct lrunode node;		/* key is the document path /**/
+	struct gzentry *qnext;		/* compression queue /**/
+	dev_t dev;			/* version of the document /**/
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	int state;			/* GZ_PENDING, GZ_READY or GZ_SKIP /**/
+	int refs;			/* users of data, and the queue /**/
+	int dead;			/* dropped from the cache /**/
+	char *data;			/* compressed body /**/
+	size_t len;			/* compressed body length /**/
+	char etag[FC_ETAG_SIZE];	/* entity tag of the gzip copy /**/
+};
+
+void             gzcache_init(int, size_t);
+int              gzcache_eligible(const struct fileinfo *);
+struct gzentry * gzcache_get(const char *, const struct fileinfo *);
+void             gzcache_put(struct gzentry *);
+void             gzcache_shrink(void);
+
+#endif /* GZCACHE_H */
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-worker queues of accepted connections.
+ *
+ * Compile using 'gcc -c handoff.c' and link handoff.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/eventfd.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "handoff.h"
+
+/* Set up an empty queue and its wakeup eventfd /**/
+void handoff_init(struct handoff *h)
+{
+	memset(h, 0, sizeof(*h));
+	if ((h->efd = eventfd(0, EFD_CLOEXEC)) == -1)
+		err(1, "eventfd failed");
+}
+
+/*
+ * Acceptor side: queue c at the bottom, -1 when the queue is full.
+ *
+ * The bottom store here and the sleeping load in handoff_wake() are
+ * sequentially consistent, like the sleeping store in handoff_idle()
+ * and the bottom load in handoff_take(): either a worker going to
+ * sleep sees the new connection, or the acceptor sees it asleep.
+ /**/
+int handoff_push(struct handoff *h, const struct handoffconn *c)
+{
+	unsigned int top, bottom;
+
+	bottom = h->bottom;
+	top = __atomic_load_n(&h->top, __ATOMIC_ACQUIRE);
+	if (bottom - top >= HANDOFF_SLOTS)
+		return -1;
+	h->ring[bottom & (HANDOFF_SLOTS - 1)] = *c;
+	__atomic_store_n(&h->bottom, bottom + 1, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+/*
+ * Any worker: take the oldest connection from the top, -1 when the
+ * queue is empty. The slot is copied before the compare and swap; the
+ * acceptor can't reuse it until top has moved past it.
+ /**/
+int handoff_take(struct handoff *h, struct handoffconn *c)
+{
+	unsigned int top, bottom;
+
+	top = __atomic_load_n(&h->top, __ATOMIC_ACQUIRE);
+	do {
+		bottom = __atomic_load_n(&h->bottom, __ATOMIC_SEQ_CST);
+		if ((int)(bottom - top) <= 0)
+			return -1;
+		*c = h->ring[top & (HANDOFF_SLOTS - 1)];
+	} while (!__atomic_compare_exchange_n(&h->top, &top, top + 1, 0,
+	    __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+	return 0;
+}
+
+/* Connections waiting in h plus the one its owner is serving /**/
+unsigned int handoff_load(struct handoff *h)
+{
+	unsigned int top, bottom;
+
+	top = __atomic_load_n(&h->top, __ATOMIC_RELAXED);
+	bottom = __atomic_load_n(&h->bottom, __ATOMIC_RELAXED);
+	return ((int)(bottom - top) > 0 ? bottom - top : 0) +
+	    __atomic_load_n(&h->busy, __ATOMIC_RELAXED);
+}
+
+/* Owner: note it started (1) or finished (0) serving a connection /**/
+void handoff_busy(struct handoff *h, int busy)
+{
+	__atomic_store_n(&h->busy, busy, __ATOMIC_RELAXED);
+}
+
+/*
+ * Owner: about to sleep. Look for work once more after this, then
+ * call handoff_wait(), or handoff_awake() if some was found.
+ /**/
+void handoff_idle(struct handoff *h)
+{
+	__atomic_store_n(&h->sleeping, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Owner: found work after all, no longer sleeping /**/
+void handoff_awake(struct handoff *h)
+{
+	__atomic_store_n(&h->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+/* Owner: sleep until the acceptor wakes it /**/
+void handoff_wait(struct handoff *h)
+{
+	uint64_t n;
+
+	while (read(h->efd, &n, sizeof(n)) == -1)
+		if (errno != EINTR)
+			err(1, "eventfd read failed");
+	__atomic_store_n(&h->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+/* Acceptor: wake the owner of h if it sleeps, return 1 if it did /**/
+int handoff_wake(struct handoff *h)
+{
+	uint64_t one = 1;
+	int sleeping = 1;
+
+	if (!__atomic_compare_exchange_n(&h->sleeping, &sleeping, 0, 0,
+	    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		return 0;
+	while (write(h->efd, &one, sizeof(one)) == -1 && errno == EINTR)
+		;
+	return 1;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hand-off of accepted connections from one acceptor thread to the
+ * worker threads of the pool engine (-w).
+ *
+ * Each worker owns a handoff: a fixed size ring of connections queued
+ * for it. The acceptor is the only thread that pushes, at the bottom,
+ * so pushing needs no lock. Connections are taken from the top with a
+ * compare and swap, oldest first: by the owning worker, or by every
+ * worker from the one queue they share with "-d shared".
+ *
+ * A worker with nothing to take marks itself sleeping and reads its
+ * eventfd. The acceptor wakes a sleeping worker after each push, so a
+ * busy worker is never woken through the kernel.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <netinet/in.h>
+#include <time.h>
+
+/* Defined Variables /**/
+#define HANDOFF_SLOTS 256		/* queue size, a power of 2 /**/
+
+struct handoffconn
+{
+	int sd;
+	struct in_addr addr;		/* client /**/
+	int local;			/* over the Unix domain socket /**/
+	struct timespec start;		/* when it was accepted /**/
+};
+
+struct handoff
+{
+	struct handoffconn ring[HANDOFF_SLOTS];
+	unsigned int top __attribute__((aligned(64)));	/* takers' /**/
+	unsigned int bottom __attribute__((aligned(64)));	/* acceptor's /**/
+	int sleeping __attribute__((aligned(64)));
+	int busy;			/* owner is serving a connection /**/
+	int efd;
+};
+
+void handoff_init(struct handoff *);
+int  handoff_push(struct handoff *, const struct handoffconn *);
+int  handoff_take(struct handoff *, struct handoffconn *);
+unsigned int handoff_load(struct handoff *);
+void handoff_busy(struct handoff *, int);
+void handoff_idle(struct handoff *);
+void handoff_awake(struct handoff *);
+void handoff_wait(struct handoff *);
+int  handoff_wake(struct handoff *);
+
+#endif /* HANDOFF_H */
@@ -0,0 +1,352 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Heavy hitters.
+ *
+ * Compile using 'gcc -c hotpath.c' and link hotpath.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "buf.h"
+#include "hotpath.h"
+#include "memory.h"
+
+/* Defined Variables /**/
+#define HOT_PATHS 0
+#define HOT_CLIENTS 1
+#define HOT_KINDS 2
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+struct hotentry
+{
+	unsigned long hits;		/* 0 if the entry is free /**/
+	unsigned long over;		/* hits may be overcounted by this /**/
+	unsigned long long bytes;	/* body bytes sent /**/
+	unsigned long notfound;		/* answered 404 /**/
+	char key[HOT_KEY];
+};
+
+/* A summary of n entries, hash[i] the hash of entry i's key /**/
+struct hotset
+{
+	int n;
+	unsigned int *hash;
+	struct hotentry *e;
+};
+
+struct hotshared
+{
+	pthread_mutex_t lock;		/* robust, process-shared /**/
+	unsigned int hash[HOT_KINDS][HOT_SLOTS];
+	struct hotentry e[HOT_KINDS][HOT_SLOTS];
+};
+
+struct hotlocal
+{
+	time_t merged;			/* when last merged /**/
+	int held;			/* counted since then /**/
+	unsigned int hash[HOT_KINDS][HOT_LOCAL];
+	struct hotentry e[HOT_KINDS][HOT_LOCAL];
+};
+
+static const char *kinds[HOT_KINDS] = { "path", "client" };
+
+static struct hotshared *shared;
+static __thread struct hotlocal *local;
+static char dumppath[PATH_MAX];
+
+/* FNV-1a hash of key /**/
+static unsigned int hot_hash(const char *key)
+{
+	unsigned int h = 2166136261u;
+
+	while (*key != '\0')
+	{
+		h ^= (unsigned char)*key++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * Take the shared lock. If its holder died the lock is made usable
+ * again; what it left half merged only miscounts.
+ /**/
+static void hot_lock(void)
+{
+	if (pthread_mutex_lock(&shared->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&shared->lock);
+}
+
+/* Point set at the summary of kind, this worker's own or the shared /**/
+static void hot_set(struct hotset *set, int kind, int own)
+{
+	if (own)
+	{
+		set->n = HOT_LOCAL;
+		set->hash = local->hash[kind];
+		set->e = local->e[kind];
+	}
+	else
+	{
+		set->n = HOT_SLOTS;
+		set->hash = shared->hash[kind];
+		set->e = shared->e[kind];
+	}
+}
+
+/*
+ * Add what from counted for its key to set, Space-Saving style: to the
+ * key's entry, a free one, or else the entry with the fewest hits,
+ * whose count becomes the new key's possible overcount.
+ /**/
+static void hot_add(struct hotset *set, unsigned int hash, 
+    const struct hotentry *from)
+{
+	struct hotentry *e, *min;
+	int i;
+
+	min = NULL;
+	for (i = 0; i < set->n; i++)
+	{
+		e = &set->e[i];
+		if (e->hits == 0)
+		{
+			if (min == NULL || min->hits > 0)
+				min = e;
+			continue;
+		}
+		if (set->hash[i] == hash && strcmp(e->key, from->key) == 0)
+		{
+			e->hits += from->hits;
+			e->over += from->over;
+			e->bytes += from->bytes;
+			e->notfound += from->notfound;
+			return;
+		}
+		if (min == NULL || e->hits < min->hits)
+			min = e;
+	}
+	set->hash[min - set->e] = hash;
+	min->over = min->hits + from->over;
+	min->hits += from->hits;
+	min->bytes = from->bytes;
+	min->notfound = from->notfound;
+	strlcpy(min->key, from->key, sizeof(min->key));
+}
+
+/* Count req under the path of len bytes at path, if any, and ip /**/
+static void hot_count(int own, struct hotentry *req, const char *path,
+    size_t len, const char *ip)
+{
+	struct hotset set;
+
+	if (len > 0)
+	{
+		snprintf(req->key, sizeof(req->key), "%.*s", (int)len, path);
+		hot_set(&set, HOT_PATHS, own);
+		hot_add(&set, hot_hash(req->key), req);
+	}
+	strlcpy(req->key, ip, sizeof(req->key));
+	hot_set(&set, HOT_CLIENTS, own);
+	hot_add(&set, hot_hash(req->key), req);
+}
+
+/*
+ * Map the shared summary, in the parent before any child is forked.
+ * SIGUSR1 writes the top entries to the file at path.
+ /**/
+void hotpath_init(const char *path)
+{
+	pthread_mutexattr_t attr;
+
+	shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		err(1, "can't map hot paths");
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (pthread_mutex_init(&shared->lock, &attr) != 0)
+		err(1, "can't init hot paths lock");
+	pthread_mutexattr_destroy(&attr);
+	strlcpy(dumppath, path, sizeof(dumppath));
+}
+
+/*
+ * Count the requests of this thread, a worker that lives on, in a
+ * summary of its own. Without one they are counted in the shared one.
+ /**/
+void hotpath_worker(void)
+{
+	if (shared == NULL || local != NULL || 
+	    (local = calloc(1, sizeof(*local))) == NULL)
+		return;
+	memory_charge(MEM_BUFFERS, sizeof(*local));
+	local->merged = time(NULL);
+}
+
+/*
+ * Count one request as it is logged: its request line, how it
+ * completed, ie) "200 OK 8954/8954" or "404 Not Found", and the client.
+ /**/
+void hotpath_record(const char *getline, const char *completion, 
+    const char *ip)
+{
+	struct hotentry req;
+	const char *path, *p;
+	size_t len;
+
+	if (shared == NULL)
+		return;
+	req.hits = 1;
+	req.over = 0;
+	req.notfound = atoi(completion) == 404;
+	/* Body bytes written come before the slash /**/
+	req.bytes = 0;
+	if ((p = strrchr(completion, ' ')) != NULL && strchr(p, '/') != NULL)
+		req.bytes = strtoull(p + 1, NULL, 10);
+
+	/* The path is the second word of the line, less any query /**/
+	path = getline + strcspn(getline, " \r\n");
+	len = 0;
+	if (*path == ' ')
+		len = strcspn(++path, " ?\r\n");
+
+	if (local == NULL)
+	{
+		hot_lock();
+		hot_count(0, &req, path, len, ip);
+		pthread_mutex_unlock(&shared->lock);
+		return;
+	}
+	hot_count(1, &req, path, len, ip);
+	local->held = 1;
+	if (time(NULL) != local->merged)
+		hotpath_flush();
+}
+
+/* Merge this worker's own summary into the shared one, then empty it /**/
+void hotpath_flush(void)
+{
+	struct hotset set;
+	int i, k;
+
+	if (local == NULL || !local->held)
+		return;
+	hot_lock();
+	for (k = 0; k < HOT_KINDS; k++)
+	{
+		hot_set(&set, k, 0);
+		for (i = 0; i < HOT_LOCAL; i++)
+			if (local->e[k][i].hits > 0)
+				hot_add(&set, local->hash[k][i], 
+				    &local->e[k][i]);
+	}
+	pthread_mutex_unlock(&shared->lock);
+	memset(local->e, 0, sizeof(local->e));
+	local->merged = time(NULL);
+	local->held = 0;
+}
+
+/* Check for counts of this worker not merged, it must wake to merge /**/
+int hotpath_pending(void)
+{
+	return local != NULL && local->held;
+}
+
+/* Merge this worker's counts if they have waited into a new second /**/
+void hotpath_tick(void)
+{
+	if (hotpath_pending() && time(NULL) != local->merged)
+		hotpath_flush();
+}
+
+/*
+ * Append the top entries of each kind, most hits first, as lines of
+ * "hot_path hits over bytes notfound /path" and "hot_client ..." with
+ * the client in place of the path. hits - over is a lower bound.
+ /**/
+size_t hotpath_status(struct buf *b)
+{
+	struct hotentry *e;
+	size_t start = b->len;
+	int idx[HOT_SLOTS];
+	int i, j, k, n, t;
+
+	if (shared == NULL)
+		return 0;
+	hotpath_flush();
+	hot_lock();
+	for (k = 0; k < HOT_KINDS; k++)
+	{
+		e = shared->e[k];
+		for (i = n = 0; i < HOT_SLOTS; i++)
+			if (e[i].hits > 0)
+				idx[n++] = i;
+		/* Selection sort, only the top is wanted /**/
+		for (i = 0; i < n && i < HOT_SHOW; i++)
+		{
+			for (j = i + 1; j < n; j++)
+				if (e[idx[j]].hits > e[idx[i]].hits)
+				{
+					t = idx[i];
+					idx[i] = idx[j];
+					idx[j] = t;
+				}
+			buf_printf(b, "hot_%s %lu %lu %llu %lu %s\n", kinds[k],
+			    e[idx[i]].hits, e[idx[i]].over, e[idx[i]].bytes,
+			    e[idx[i]].notfound, e[idx[i]].key);
+		}
+	}
+	pthread_mutex_unlock(&shared->lock);
+	return b->len - start;
+}
+
+/* Write the top entries to the file given to hotpath_init() /**/
+void hotpath_dump(void)
+{
+	struct buf b;
+	FILE *f;
+
+	if (shared == NULL)
+		return;
+	if ((f = fopen(dumppath, "w")) == NULL)
+	{
+		warn("can't write %s", dumppath);
+		return;
+	}
+	buf_init(&b, NULL, 0);
+	hotpath_status(&b);
+	fwrite(b.data, 1, b.len, f);
+	fclose(f);
+	buf_free(&b);
+}
@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Heavy hitters: the paths and clients with the most requests.
+ *
+ * Each request as logged is counted in a Space-Saving summary: a fixed
+ * number of entries, a key's hits counted exactly while it holds one
+ * and a new key taking over the entry with the fewest hits, inheriting
+ * that count as its possible overcount. Long lived workers (pool
+ * threads, prefork processes, event loops) count in a small summary of
+ * their own without a lock and merge it into one shared by every
+ * process once a second; an idle worker wakes to, or merges before it
+ * sleeps, so none holds counts back. Others count in the shared one.
+ * The top of it, with bytes sent and 404s, is on STATUS_PATH and
+ * written to a file on SIGUSR1. Costs one hash and a short scan a
+ * request.
+ */
+
+#ifndef HOTPATH_H
+#define HOTPATH_H
+
+#include <sys/types.h>
+
+/* Defined Variables /**/
+#define HOT_LOCAL 32		/* entries of a worker's own summary /**/
+#define HOT_SLOTS 256		/* entries of the shared summary /**/
+#define HOT_SHOW 20		/* top entries reported /**/
+#define HOT_KEY 96		/* longest path or client kept /**/
+
+struct buf;
+
+void   hotpath_init(const char *);
+void   hotpath_worker(void);
+void   hotpath_record(const char *, const char *, const char *);
+void   hotpath_flush(void);
+int    hotpath_pending(void);
+void   hotpath_tick(void);
+size_t hotpath_status(struct buf *);
+void   hotpath_dump(void);
+
+#endif /* HOTPATH_H */
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Listening sockets.
+ *
+ * Compile using 'gcc -c listener.c' and link listener.o into each server.
+ */
+
+/* struct ucred /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "listener.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define SOMAXCONN_PATH "/proc/sys/net/core/somaxconn"
+
+static int backlog;		/* 0 for somaxconn /**/
+static int defer;		/* seconds of TCP_DEFER_ACCEPT, 0 is off /**/
+static int fastopen;		/* TCP_FASTOPEN queue length, 0 is off /**/
+
+/* The most the kernel will queue, SOMAXCONN if it won't say /**/
+static int listener_somaxconn(void)
+{
+	FILE *f;
+	int n;
+
+	if ((f = fopen(SOMAXCONN_PATH, "r")) == NULL)
+		return SOMAXCONN;
+	if (fscanf(f, "%d", &n) != 1 || n <= 0)
+		n = SOMAXCONN;
+	fclose(f);
+	return n;
+}
+
+/*
+ * Set the accept queue length, 0 for the kernel's limit, and the
+ * TCP_DEFER_ACCEPT seconds and TCP_FASTOPEN queue length, 0 for off.
+ * Returns the queue length listeners will have.
+ /**/
+int listener_init(int qlen, int defersecs, int tfoqlen)
+{
+	backlog = qlen > 0 ? qlen : listener_somaxconn();
+	defer = defersecs;
+	fastopen = tfoqlen;
+	return backlog;
+}
+
+/* Parse the port given on the command line /**/
+u_short listener_port(const char *port)
+{
+	u_long p;
+	char *ep;
+
+	errno = 0;
+	p = strtoul(port, &ep, 10);
+	/* Port parameter is null or non numerical /**/
+	if (*port == '\0' || *ep != '\0')
+		errx(1, "port is not a number: %s", port);
+	/* Port is out of range /**/
+	if ((errno == ERANGE && p == ULONG_MAX) || p > USHRT_MAX)
+		errx(1, "port value out of range: %s", port);
+	return p;
+}
+
+/*
+ * Listen on port of every address. With cpu other than -1 the socket
+ * joins a SO_REUSEPORT group and asks for the connections handled by
+ * that CPU. Options the kernel refuses are warned about and skipped.
+ /**/
+int listener_open(u_short port, int cpu)
+{
+	struct sockaddr_in sockname;
+	int sd, one = 1;
+
+	memset(&sockname, 0, sizeof(sockname));
+	sockname.sin_family = AF_INET;
+	sockname.sin_port = htons(port);
+	sockname.sin_addr.s_addr = htonl(INADDR_ANY);
+	if ((sd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		err(1, "socket failed");
+	if (cpu != -1 && (setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &one,
+	    sizeof(one)) == -1 || setsockopt(sd, SOL_SOCKET, SO_INCOMING_CPU,
+	    &cpu, sizeof(cpu)) == -1))
+		err(1, "setsockopt failed");
+	if (bind(sd, (struct sockaddr *) &sockname, sizeof(sockname)) == -1)
+		err(1, "bind failed");
+	if (defer > 0 && setsockopt(sd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+	    &defer, sizeof(defer)) == -1)
+		warn("TCP_DEFER_ACCEPT");
+	if (fastopen > 0 && setsockopt(sd, IPPROTO_TCP, TCP_FASTOPEN,
+	    &fastopen, sizeof(fastopen)) == -1)
+		warn("TCP_FASTOPEN");
+	if (listen(sd, backlog) == -1)
+		err(1, "listen failed");
+	return sd;
+}
+
+/*
+ * Listen on the Unix domain socket at path, in the abstract namespace
+ * when it starts with '@'. A socket file left by an earlier run is
+ * removed first; anything else at path is refused, never removed.
+ /**/
+int listener_unix(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	socklen_t len;
+	int sd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun.sun_path))
+		errx(1, "socket path too long: %s", path);
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+	len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+	if (path[0] == '@')
+		sun.sun_path[0] = '\0';
+	else
+	{
+		if (lstat(path, &st) == 0)
+		{
+			if (!S_ISSOCK(st.st_mode))
+				errx(1, "not a socket: %s", path);
+			unlink(path);
+		}
+		len++;
+	}
+	if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		err(1, "socket failed");
+	if (bind(sd, (struct sockaddr *) &sun, len) == -1)
+		err(1, "bind failed: %s", path);
+	if (listen(sd, backlog) == -1)
+		err(1, "listen failed");
+	return sd;
+}
+
+/*
+ * Wait for a connection on sd or, when not -1, usd and return the one
+ * ready. Without usd sd is returned at once for a blocking accept().
+ * Returns -1 if a signal came first.
+ /**/
+int listener_ready(int sd, int usd)
+{
+	struct pollfd pfd[2];
+
+	if (usd == -1)
+		return sd;
+	pfd[0].fd = sd;
+	pfd[1].fd = usd;
+	pfd[0].events = pfd[1].events = POLLIN;
+	if (SYSCOUNT(SC_IDLE, poll(pfd, 2, -1)) == -1)
+	{
+		if (errno != EINTR)
+			err(1, "poll failed");
+		return -1;
+	}
+	return pfd[1].revents & POLLIN ? usd : sd;
+}
+
+/* Name the client of Unix domain socket sd by its credentials /**/
+void listener_peer(int sd, char *ip, size_t size)
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		snprintf(ip, size, "%s?", PEER_UNIX);
+	else
+		snprintf(ip, size, "%s%u.%d", PEER_UNIX, (unsigned)cred.uid,
+		    (int)cred.pid);
+}
+
+/* Check if the client named ip came in over a Unix domain socket /**/
+int listener_local(const char *ip)
+{
+	return strncmp(ip, PEER_UNIX, strlen(PEER_UNIX)) == 0;
+}
@@ -0,0 +1,51 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Listening socket set up shared by every server engine.
+ *
+ * The backlog defaults to net.core.somaxconn rather than a handful, so
+ * a burst of connections waits in the accept queue instead of having
+ * its SYNs dropped and retried a second later. TCP_DEFER_ACCEPT holds
+ * a connection back until its request arrives, so the first wakeup for
+ * it can read the request; TCP_FASTOPEN lets a returning client send
+ * the request in its SYN. Both are off unless asked for.
+ *
+ * A same host proxy can also connect over a Unix domain socket,
+ * at a path or, starting with '@', in the abstract namespace. Such a
+ * client is named in the log by its credentials, "unix:uid.pid", or
+ * by the X-Forwarded-For address the proxy passes on.
+ */
+
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <sys/types.h>
+
+/* Prefix of the log name of a Unix domain socket client /**/
+#define PEER_UNIX "unix:"
+#define PEER_SIZE 64		/* room for any client name /**/
+
+int  listener_init(int, int, int);
+u_short listener_port(const char *);
+int  listener_open(u_short, int);
+int  listener_unix(const char *);
+int  listener_ready(int, int);
+void listener_peer(int, char *, size_t);
+int  listener_local(const char *);
+
+#endif /* LISTENER_H */
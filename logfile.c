@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Access log.
+ *
+ * Compile using 'gcc -c logfile.c' and link logfile.o into the server.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hotpath.h"
+#include "logfile.h"
+#include "response.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+#define LOG_BUF 65536		/* kept log buffer /**/
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+static char logpath[PATH_MAX];
+/* Threads each write a line whole /**/
+static pthread_mutex_t loglock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The log kept open by logfile_buffer() and its pending lines /**/
+static FILE *kept;
+static char logbuf[LOG_BUF];
+static size_t loglen;
+static time_t logflushed;
+
+/* Log to the file at path /**/
+void logfile_init(const char *path)
+{
+	strlcpy(logpath, path, sizeof(logpath));
+}
+
+/* Keep the log open and buffer its lines, for a single threaded loop /**/
+void logfile_buffer(void)
+{
+	if ((kept = SYSCOUNT(SC_LOG, fopen(logpath, "a"))) == NULL)
+		err(1, "can't open %s", logpath);
+}
+
+/* Open the log for a request, NULL if it can't be /**/
+FILE * logfile_open(void)
+{
+	if (kept != NULL)
+		return kept;
+	return SYSCOUNT(SC_LOG, fopen(logpath, "a"));
+}
+
+/* Write out the buffered lines /**/
+static void logfile_flush(void)
+{
+	size_t off;
+	ssize_t w;
+
+	for (off = 0; off < loglen; off += w)
+		if ((w = SYSCOUNT(SC_LOG, write(fileno(kept), logbuf + off, 
+		    loglen - off))) == -1)
+		{
+			if (errno != EINTR)
+				break;
+			w = 0;
+		}
+	loglen = 0;
+	logflushed = time(NULL);
+}
+
+/*
+ * Log one request to logfile, as opened by logfile_open(): its request
+ * line, which ends at a line ending or NUL so the request head may be
+ * given, how it completed and the client. A log of its own is closed.
+ /**/
+void logfile_write(FILE *logfile, const char *getline, 
+    const char *completion, const char *ip)
+{
+	char line[BUF_SIZE];
+	int n, len;
+
+	hotpath_record(getline, completion, ip);
+	len = strcspn(getline, "\r\n");
+	if (logfile != kept)
+	{
+		pthread_mutex_lock(&loglock);
+		fprintf(logfile, "%s\t%s\t%.*s\t%s\n", response_date(NULL), 
+		    ip, len, getline, completion);
+		SYSCOUNT(SC_LOG, fclose(logfile));
+		pthread_mutex_unlock(&loglock);
+		syscount_request(completion);
+		return;
+	}
+	n = snprintf(line, sizeof(line), "%s\t%s\t%.*s\t%s\n", 
+	    response_date(NULL), ip, len, getline, completion);
+	if (n >= sizeof(line))
+	{
+		n = sizeof(line) - 1;
+		line[n - 1] = '\n';
+	}
+	if (loglen + n > sizeof(logbuf))
+		logfile_flush();
+	memcpy(logbuf + loglen, line, n);
+	loglen += n;
+	syscount_request(completion);
+}
+
+/* Check for buffered lines, the loop must wake to write them /**/
+int logfile_pending(void)
+{
+	return loglen > 0;
+}
+
+/* Write out the buffered lines if they have waited into a new second /**/
+void logfile_tick(void)
+{
+	if (loglen > 0 && time(NULL) != logflushed)
+		logfile_flush();
+}
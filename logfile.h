@@ -0,0 +1,41 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Access log shared by every engine.
+ *
+ * Each request opens the log, writes its line and closes it again, so
+ * the log can be moved away under a running server. Per core event
+ * loops keep it open instead and buffer whole lines, written out with
+ * one O_APPEND write() each time the buffer fills and at least once a
+ * second, so the loops of other cores never split a line.
+ */
+
+#ifndef LOGFILE_H
+#define LOGFILE_H
+
+#include <stdio.h>
+
+void   logfile_init(const char *);
+void   logfile_buffer(void);
+FILE * logfile_open(void);
+void   logfile_write(FILE *, const char *, const char *, const char *);
+int    logfile_pending(void);
+void   logfile_tick(void);
+
+#endif /* LOGFILE_H */
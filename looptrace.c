@@ -0,0 +1,215 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event loop trace.
+ *
+ * Compile using 'gcc -c looptrace.c' and link looptrace.o into each
+ * server.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "looptrace.h"
+#include "memory.h"
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+/* One turn of the loop, times in monotonic ns /**/
+struct looptick
+{
+	long long waited;		/* the wait began /**/
+	long long woke;			/* it returned /**/
+	long long done;			/* every ready fd was handled /**/
+	long long slowat;		/* the longest handler began /**/
+	long long slowns;		/* and took, 0 without one /**/
+	int ready;			/* fds the wait returned /**/
+	int slowkind;			/* LT_ kind of the longest /**/
+	int slowfd;			/* its fd, -1 for none /**/
+	int states[LT_STATES];		/* connections in each state /**/
+};
+
+static const char *kinds[LT_KINDS] = {
+	"accept", "read", "write", "load", "log"
+};
+
+static const char *states[LT_STATES] = {
+	"unused", "reading", "writing", "parked"
+};
+
+static struct looptick *ring;
+static struct looptick cur;
+static unsigned long turns;		/* recorded, the next at % records /**/
+static int records;			/* turns kept, 0 is off /**/
+static char tracepath[PATH_MAX];
+
+/* Monotonic nanoseconds /**/
+static long long lt_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Keep the last n turns of each event loop, 0 for none, written to
+ * path when asked. The path must leave room for the ".cpu" suffix.
+ /**/
+void looptrace_init(int n, const char *path)
+{
+	records = n;
+	if (strlcpy(tracepath, path, sizeof(tracepath)) + 
+	    sizeof(".2147483647") > sizeof(tracepath) && n != 0)
+		errx(1, "trace path too long %s", path);
+}
+
+/*
+ * Start the ring of this loop, pinned to cpu unless it is -1. With a
+ * loop per CPU each writes its own file, the path with ".cpu" added.
+ /**/
+void looptrace_loop(int cpu)
+{
+	char path[PATH_MAX];
+
+	if (records == 0)
+		return;
+	if ((ring = calloc(records, sizeof(*ring))) == NULL)
+		err(1, "can't allocate the loop trace");
+	memory_charge(MEM_BUFFERS, records * sizeof(*ring));
+	if (cpu != -1)
+	{
+		if (snprintf(path, sizeof(path), "%s.%d", tracepath, cpu) >=
+		    sizeof(path))
+			errx(1, "trace path too long %s", tracepath);
+		strlcpy(tracepath, path, sizeof(tracepath));
+	}
+}
+
+/* The loop is about to wait /**/
+void looptrace_wait(void)
+{
+	if (ring == NULL)
+		return;
+	memset(&cur, 0, sizeof(cur));
+	cur.slowfd = -1;
+	cur.waited = lt_now();
+}
+
+/* The wait returned n, the ready fds or -1 /**/
+void looptrace_woke(int n)
+{
+	if (ring == NULL)
+		return;
+	cur.woke = lt_now();
+	cur.ready = n > 0 ? n : 0;
+}
+
+/* A handler starts, returns the time to give looptrace_end() /**/
+long long looptrace_begin(void)
+{
+	return ring != NULL ? lt_now() : 0;
+}
+
+/* A handler of kind on fd begun at start is done /**/
+void looptrace_end(long long start, int kind, int fd)
+{
+	long long ns;
+
+	if (start == 0)
+		return;
+	ns = lt_now() - start;
+	if (ns > cur.slowns)
+	{
+		cur.slowat = start;
+		cur.slowns = ns;
+		cur.slowkind = kind;
+		cur.slowfd = fd;
+	}
+}
+
+/* The turn is over, with count[s] connections in each state s /**/
+void looptrace_done(const int *count)
+{
+	if (ring == NULL)
+		return;
+	cur.done = lt_now();
+	memcpy(cur.states, count, sizeof(cur.states));
+	ring[turns++ % records] = cur;
+}
+
+/*
+ * Write the turns in the ring, oldest first, as Chrome trace events:
+ * the wait and the dispatch of each turn, its longest handler inside
+ * the dispatch and the connections in each state as a counter.
+ /**/
+void looptrace_dump(void)
+{
+	struct looptick *t;
+	unsigned long i;
+	FILE *f;
+	int pid, s;
+
+	if (ring == NULL)
+		return;
+	if ((f = fopen(tracepath, "w")) == NULL)
+	{
+		warn("can't write %s", tracepath);
+		return;
+	}
+	pid = getpid();
+	fprintf(f, "{\"traceEvents\":[\n{\"name\":\"thread_name\",\"ph\":"
+	    "\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"event loop\"}}",
+	    pid);
+	for (i = turns > records ? turns - records : 0; i < turns; i++)
+	{
+		t = &ring[i % records];
+		fprintf(f, ",\n{\"name\":\"wait\",\"ph\":\"X\",\"ts\":%.3f,"
+		    "\"dur\":%.3f,\"pid\":%d,\"tid\":1,\"args\":{\"ready\":"
+		    "%d}}", t->waited / 1e3, (t->woke - t->waited) / 1e3, 
+		    pid, t->ready);
+		fprintf(f, ",\n{\"name\":\"dispatch\",\"ph\":\"X\",\"ts\":"
+		    "%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1,\"args\":"
+		    "{\"ready\":%d,\"longest_us\":%.3f}}", t->woke / 1e3, 
+		    (t->done - t->woke) / 1e3, pid, t->ready, 
+		    t->slowns / 1e3);
+		if (t->slowns > 0)
+			fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"handler\","
+			    "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":"
+			    "%d,\"tid\":1,\"args\":{\"fd\":%d}}", 
+			    kinds[t->slowkind], t->slowat / 1e3, 
+			    t->slowns / 1e3, pid, t->slowfd);
+		fprintf(f, ",\n{\"name\":\"connections\",\"ph\":\"C\","
+		    "\"ts\":%.3f,\"pid\":%d,\"tid\":1,\"args\":{", 
+		    t->done / 1e3, pid);
+		for (s = 0; s < LT_STATES; s++)
+			fprintf(f, "%s\"%s\":%d", s > 0 ? "," : "", states[s],
+			    t->states[s]);
+		fprintf(f, "}}");
+	}
+	fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(f);
+}
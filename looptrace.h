@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event loop trace: a ring of the last turns of an event loop.
+ *
+ * Each turn records when the loop began waiting, when it woke and with
+ * how many ready fds, when it was done dispatching them, the longest
+ * handler of the turn and how many connections were in each state.
+ * Off (the default) every hook is a test; on it reads the clock about
+ * twice per handler, and the ring is written on demand as Chrome
+ * trace event JSON, to be opened in chrome://tracing or Perfetto, so
+ * a stall shows on a timeline as one long handler.
+ */
+
+#ifndef LOOPTRACE_H
+#define LOOPTRACE_H
+
+#include <sys/types.h>
+
+/* What a handler did /**/
+#define LT_ACCEPT 0
+#define LT_READ 1
+#define LT_WRITE 2
+#define LT_LOAD 3		/* resuming connections parked on a load /**/
+#define LT_LOG 4		/* writing out the buffered log /**/
+#define LT_KINDS 5
+
+/* Connection states counted each turn, as the event engine's /**/
+#define LT_STATES 4
+
+void      looptrace_init(int, const char *);
+void      looptrace_loop(int);
+void      looptrace_wait(void);
+void      looptrace_woke(int);
+long long looptrace_begin(void);
+void      looptrace_end(long long, int, int);
+void      looptrace_done(const int *);
+void      looptrace_dump(void);
+
+#endif /* LOOPTRACE_H */
@@ -0,0 +1,128 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hash and LRU index of the caches.
+ *
+ * Compile using 'gcc -c lrucache.c' and link lrucache.o into each
+ * server.
+ */
+
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "lrucache.h"
+
+/* FNV-1a hash of a path /**/
+unsigned int lru_hash(const char *path)
+{
+	unsigned int h = 2166136261u;
+
+	while (*path != '\0')
+	{
+		h ^= (unsigned char)*path++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* The entry for key, NULL if there is none /**/
+struct lrunode * lru_find(struct lrucache *c, const char *key)
+{
+	struct lrunode *n;
+
+	for (n = c->table[lru_hash(key) % LRU_BUCKETS]; n != NULL; 
+	    n = n->next)
+		if (strcmp(n->key, key) == 0)
+			return n;
+	return NULL;
+}
+
+/* Add an entry, its key and bytes set, as the most recently used /**/
+void lru_insert(struct lrucache *c, struct lrunode *n)
+{
+	struct lrunode **bp = &c->table[lru_hash(n->key) % LRU_BUCKETS];
+
+	n->next = *bp;
+	*bp = n;
+	n->lprev = n->lnext = NULL;
+	lru_touch(c, n);
+	c->bytes += n->bytes;
+}
+
+/* Move an entry to the front of the LRU list /**/
+void lru_touch(struct lrucache *c, struct lrunode *n)
+{
+	if (c->head == n)
+		return;
+	/* Unlink, entries not yet listed have no neighbours /**/
+	if (n->lprev != NULL)
+		n->lprev->lnext = n->lnext;
+	if (n->lnext != NULL)
+		n->lnext->lprev = n->lprev;
+	if (c->tail == n)
+		c->tail = n->lprev;
+	n->lprev = NULL;
+	n->lnext = c->head;
+	if (c->head != NULL)
+		c->head->lprev = n;
+	c->head = n;
+	if (c->tail == NULL)
+		c->tail = n;
+}
+
+/* Charge an entry for bytes more, its body once it is made /**/
+void lru_charge(struct lrucache *c, struct lrunode *n, size_t bytes)
+{
+	n->bytes += bytes;
+	c->bytes += bytes;
+}
+
+/* Take an entry out of the table and the list, with its bytes /**/
+void lru_remove(struct lrucache *c, struct lrunode *n)
+{
+	struct lrunode **np;
+
+	for (np = &c->table[lru_hash(n->key) % LRU_BUCKETS]; *np != NULL;
+	    np = &(*np)->next)
+		if (*np == n)
+		{
+			*np = n->next;
+			break;
+		}
+	if (n->lprev != NULL)
+		n->lprev->lnext = n->lnext;
+	else if (c->head == n)
+		c->head = n->lnext;
+	if (n->lnext != NULL)
+		n->lnext->lprev = n->lprev;
+	else if (c->tail == n)
+		c->tail = n->lprev;
+	n->lprev = n->lnext = NULL;
+	c->bytes -= n->bytes;
+}
+
+/*
+ * Drop the least recently used entries, but not keep, until at most
+ * target bytes are charged. keep is NULL to spare none.
+ /**/
+void lru_evict(struct lrucache *c, size_t target, struct lrunode *keep)
+{
+	while (c->bytes > target && c->tail != NULL && c->tail != keep)
+		c->drop(c->tail);
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Index shared by the in-process caches: a hash table of entries by
+ * path and a list of them, most recently used first, with the bytes
+ * each is charged for.
+ *
+ * A cache embeds struct lrunode first in its entries and gives the
+ * function that drops one. Every call must be made holding the lock
+ * of the cache.
+ */
+
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <sys/types.h>
+
+/* Defined Variables /**/
+#define LRU_BUCKETS 1024
+
+struct lrunode
+{
+	struct lrunode *next;		/* hash chain /**/
+	struct lrunode *lprev;		/* LRU list, most recent first /**/
+	struct lrunode *lnext;
+	char *key;			/* path the entry is found by /**/
+	size_t bytes;			/* charged to the cache /**/
+};
+
+struct lrucache
+{
+	struct lrunode *table[LRU_BUCKETS];
+	struct lrunode *head, *tail;
+	size_t bytes;			/* charged for every entry /**/
+	void (*drop)(struct lrunode *);	/* lru_remove() it, may free it /**/
+};
+
+unsigned int     lru_hash(const char *);
+struct lrunode * lru_find(struct lrucache *, const char *);
+void             lru_insert(struct lrucache *, struct lrunode *);
+void             lru_touch(struct lrucache *, struct lrunode *);
+void             lru_charge(struct lrucache *, struct lrunode *, size_t);
+void             lru_remove(struct lrucache *, struct lrunode *);
+void             lru_evict(struct lrucache *, size_t, struct lrunode *);
+
+#endif /* LRUCACHE_H */
@@ -0,0 +1,200 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory budget.
+ *
+ * Compile using 'gcc -c memory.c' and link memory.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <err.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "buf.h"
+#include "memory.h"
+
+/* Defined Variables /**/
+#define MEM_SHRINKERS 4
+
+struct memory
+{
+	size_t limit;			/* 0 means no limit /**/
+	size_t held;
+	size_t peak;
+	size_t kind[MEM_KINDS];
+	unsigned long refused;		/* charges over the limit /**/
+	unsigned long streamed;		/* bodies sent from their file /**/
+	unsigned long paused;		/* times accepting was held back /**/
+	unsigned long shrunk;		/* times the caches were shrunk /**/
+};
+
+static const char *kinds[MEM_KINDS] = { "buffers", "caches", "stacks" };
+
+static struct memory *mem;
+static void (*shrinkers[MEM_SHRINKERS])(void);
+static int nshrinkers;
+static time_t shrunk_at;
+
+/*
+ * Set the ceiling in bytes, 0 for none. The counters are mapped shared
+ * so forked children charge the parent's copy. Until this is called
+ * nothing is counted.
+ /**/
+void memory_init(size_t limit)
+{
+	mem = mmap(NULL, sizeof(*mem), PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+		err(1, "can't map memory counters");
+	mem->limit = limit;
+}
+
+/* Raise the peak to held if it is higher /**/
+static void memory_peak(size_t held)
+{
+	size_t peak;
+
+	peak = __atomic_load_n(&mem->peak, __ATOMIC_RELAXED);
+	while (held > peak && !__atomic_compare_exchange_n(&mem->peak, 
+	    &peak, held, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * Charge n bytes of kind if that stays within the ceiling. Returns -1,
+ * counted as refused, if it doesn't; nothing is charged then.
+ /**/
+int memory_take(int kind, size_t n)
+{
+	size_t held;
+
+	if (mem == NULL)
+		return 0;
+	held = __atomic_load_n(&mem->held, __ATOMIC_RELAXED);
+	do
+	{
+		if (mem->limit > 0 && held + n > mem->limit)
+		{
+			__atomic_add_fetch(&mem->refused, 1, __ATOMIC_RELAXED);
+			return -1;
+		}
+	} while (!__atomic_compare_exchange_n(&mem->held, &held, held + n,
+	    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	__atomic_add_fetch(&mem->kind[kind], n, __ATOMIC_RELAXED);
+	memory_peak(held + n);
+	return 0;
+}
+
+/* Charge n bytes of kind that are held whatever the ceiling /**/
+void memory_charge(int kind, size_t n)
+{
+	if (mem == NULL)
+		return;
+	__atomic_add_fetch(&mem->kind[kind], n, __ATOMIC_RELAXED);
+	memory_peak(__atomic_add_fetch(&mem->held, n, __ATOMIC_RELAXED));
+}
+
+/* Give back n bytes of kind taken or charged before /**/
+void memory_give(int kind, size_t n)
+{
+	if (mem == NULL)
+		return;
+	__atomic_sub_fetch(&mem->kind[kind], n, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&mem->held, n, __ATOMIC_RELAXED);
+}
+
+/* Have fn called to shed cached bytes of this process under pressure /**/
+void memory_shrinker(void (*fn)(void))
+{
+	if (nshrinkers < MEM_SHRINKERS)
+		shrinkers[nshrinkers++] = fn;
+}
+
+/*
+ * Check if the bytes held are past the high mark, shrinking the caches
+ * of this process first, at most once a second.
+ /**/
+int memory_pressure(void)
+{
+	time_t now;
+	int i;
+
+	if (mem == NULL || mem->limit == 0 || 
+	    __atomic_load_n(&mem->held, __ATOMIC_RELAXED) < 
+	    MEM_HIGH(mem->limit))
+		return 0;
+	now = time(NULL);
+	if (__atomic_exchange_n(&shrunk_at, now, __ATOMIC_RELAXED) != now)
+	{
+		for (i = 0; i < nshrinkers; i++)
+			shrinkers[i]();
+		__atomic_add_fetch(&mem->shrunk, 1, __ATOMIC_RELAXED);
+	}
+	return __atomic_load_n(&mem->held, __ATOMIC_RELAXED) >= 
+	    MEM_HIGH(mem->limit);
+}
+
+/*
+ * Hold back an engine about to accept until the pressure is off, so
+ * new connections wait in the listen queue instead of taking memory.
+ /**/
+void memory_wait(void)
+{
+	if (!memory_pressure())
+		return;
+	memory_paused();
+	do
+		poll(NULL, 0, MEM_WAIT_MS);
+	while (memory_pressure());
+}
+
+/* Count an engine holding back from accepting /**/
+void memory_paused(void)
+{
+	if (mem != NULL)
+		__atomic_add_fetch(&mem->paused, 1, __ATOMIC_RELAXED);
+}
+
+/* Count a body sent from its file for want of memory /**/
+void memory_streamed(void)
+{
+	if (mem != NULL)
+		__atomic_add_fetch(&mem->streamed, 1, __ATOMIC_RELAXED);
+}
+
+/* Append the counters as "name value" lines for the status page /**/
+size_t memory_status(struct buf *b)
+{
+	size_t start = b->len;
+	int i;
+
+	if (mem == NULL)
+		return 0;
+	buf_printf(b, "memory_limit %zu\nmemory_held %zu\n"
+	    "memory_peak %zu\n", mem->limit, mem->held, mem->peak);
+	for (i = 0; i < MEM_KINDS; i++)
+		buf_printf(b, "memory_%s %zu\n", kinds[i], mem->kind[i]);
+	buf_printf(b, "memory_refused %lu\nmemory_streamed %lu\n"
+	    "memory_paused %lu\nmemory_shrunk %lu\n", mem->refused, 
+	    mem->streamed, mem->paused, mem->shrunk);
+	return b->len - start;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory budget shared by every server engine.
+ *
+ * The bytes held in growing buffers, cached bodies and the stacks of
+ * serving threads are charged against one ceiling, kept in a shared
+ * mapping like the admission counters so forked children charge their
+ * parent's. A charge that would go over the ceiling is refused and the
+ * caller gets by without: a body is sent from its file instead of a
+ * buffer, a load isn't cached, a thread isn't started. Past the high
+ * mark the caches are asked to shrink and engines stop accepting until
+ * enough is given back. The counters are exported on STATUS_PATH.
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <sys/types.h>
+
+/* What the bytes are held in /**/
+#define MEM_BUFFERS 0
+#define MEM_CACHES 1
+#define MEM_STACKS 2
+#define MEM_KINDS 3
+
+/* Pressure from 7/8 of the ceiling /**/
+#define MEM_HIGH(limit) ((limit) - (limit) / 8)
+
+/* Pressure checked this often when paused /**/
+#define MEM_WAIT_MS 10
+
+struct buf;
+
+void   memory_init(size_t);
+int    memory_take(int, size_t);
+void   memory_charge(int, size_t);
+void   memory_give(int, size_t);
+void   memory_shrinker(void (*)(void));
+int    memory_pressure(void);
+void   memory_wait(void);
+void   memory_paused(void);
+void   memory_streamed(void);
+size_t memory_status(struct buf *);
+
+#endif /* MEMORY_H */
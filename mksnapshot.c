@@ -0,0 +1,351 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pack a document directory into a snapshot archive (see snapshot.h).
+ *
+ * Compile using 'make mksnapshot' or 'make all'
+ *
+ * Run as ./mksnapshot /some/where/documents /some/where/snapshot
+ * Sidecars made by precompress.sh are packed as codings of their file.
+ * The archive is written next to its final name and renamed over it,
+ * so a running server given -a /some/where/snapshot can be sent SIGHUP
+ * to pick the new one up.
+ */
+
+/* nftw() /**/
+#define _XOPEN_SOURCE 700
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "encoding.h"
+#include "filecache.h"
+#include "response.h"
+#include "snapshot.h"
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+#define MAX_SEED 10000000
+
+struct doc
+{
+	char *file;		/* file name on disk /**/
+	char *path;		/* request path, ie) "/index.html" /**/
+	uint32_t bucket;	/* first level hash bucket /**/
+	uint32_t slot;		/* entry it was placed in /**/
+};
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+static int  collect(const char *, const struct stat *, int, struct FTW *);
+static void place(uint32_t);
+static void pack(const char *);
+
+/* Global variables /**/
+static struct doc *docs;
+static uint32_t ndocs, maxdocs;
+static size_t rootlen;
+static uint32_t nbuckets;
+static uint32_t *seeds;
+
+int main(int argc, char *argv[])
+{
+	char root[PATH_MAX];
+
+	if (argc != 3)
+		errx(1, "RUN AS: ./mksnapshot /dir/documents /dir/snapshot");
+	strlcpy(root, argv[1], sizeof(root));
+	/* Request paths start at the slash after the root /**/
+	rootlen = strlen(root);
+	while (rootlen > 1 && root[rootlen - 1] == '/')
+		root[--rootlen] = '\0';
+
+	if (nftw(root, collect, 16, FTW_PHYS) == -1)
+		err(1, "can't walk %s", root);
+	place(ndocs);
+	pack(argv[2]);
+	printf("%u documents packed into %s\n", ndocs, argv[2]);
+	return 0;
+}
+
+/* nftw() callback, list every regular file that is not a sidecar /**/
+static int collect(const char *file, const struct stat *st, int flag,
+    struct FTW *ftw)
+{
+	char base[PATH_MAX];
+	struct stat bst;
+	int enc;
+
+	if (flag != FTW_F || !S_ISREG(st->st_mode))
+		return 0;
+	/* Sidecars go in as codings of the file they belong to /**/
+	if ((enc = encoding_suffixed(file)) != ENC_IDENTITY)
+	{
+		strlcpy(base, file, sizeof(base));
+		base[strlen(base) - strlen(encoding_suffix(enc))] = '\0';
+		if (stat(base, &bst) == 0 && S_ISREG(bst.st_mode))
+			return 0;
+	}
+	if (ndocs == maxdocs)
+	{
+		maxdocs = maxdocs == 0 ? 64 : maxdocs * 2;
+		if ((docs = realloc(docs, maxdocs * sizeof(*docs))) == NULL)
+			err(1, "out of memory");
+	}
+	if ((docs[ndocs].file = strdup(file)) == NULL)
+		err(1, "out of memory");
+	docs[ndocs].path = docs[ndocs].file + rootlen;
+	ndocs++;
+	return 0;
+}
+
+/* Order buckets by size, largest first, as they are hardest to place /**/
+static uint32_t *bucket_size;
+
+static int bucket_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	if (bucket_size[x] != bucket_size[y])
+		return bucket_size[x] < bucket_size[y] ? 1 : -1;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Build a minimal perfect hash of the n request paths (hash and
+ * displace): paths are spread over buckets by one hash, then each
+ * bucket, largest first, gets the first seed that sends all its paths
+ * to entries still free.
+ /**/
+static void place(uint32_t n)
+{
+	uint32_t *order, *first, *members, *taken, *slots;
+	uint32_t i, j, k, b, m, seed;
+	const char *path;
+
+	nbuckets = n / 2 + 1;
+	if ((seeds = calloc(nbuckets, sizeof(*seeds))) == NULL ||
+	    (bucket_size = calloc(nbuckets, sizeof(*bucket_size))) == NULL ||
+	    (order = calloc(nbuckets, sizeof(*order))) == NULL ||
+	    (first = calloc(nbuckets + 1, sizeof(*first))) == NULL ||
+	    (members = calloc(n + 1, sizeof(*members))) == NULL ||
+	    (slots = calloc(n + 1, sizeof(*slots))) == NULL ||
+	    (taken = calloc(n + 1, sizeof(*taken))) == NULL)
+		err(1, "out of memory");
+	for (i = 0; i < n; i++)
+	{
+		path = docs[i].path;
+		docs[i].bucket = snapshot_hash(path, strlen(path), 0) % 
+		    nbuckets;
+		bucket_size[docs[i].bucket]++;
+	}
+	/* Group the documents by bucket /**/
+	for (b = 0; b < nbuckets; b++)
+		first[b + 1] = first[b] + bucket_size[b];
+	for (i = 0; i < n; i++)
+		members[first[docs[i].bucket]++] = i;
+	for (b = nbuckets; b > 0; b--)
+		first[b] = first[b - 1];
+	first[0] = 0;
+	for (b = 0; b < nbuckets; b++)
+		order[b] = b;
+	qsort(order, nbuckets, sizeof(*order), bucket_cmp);
+
+	for (k = 0; k < nbuckets && bucket_size[order[k]] > 0; k++)
+	{
+		b = order[k];
+		m = bucket_size[b];
+		for (seed = 1; seed < MAX_SEED; seed++)
+		{
+			for (i = 0; i < m; i++)
+			{
+				path = docs[members[first[b] + i]].path;
+				slots[i] = snapshot_hash(path, strlen(path), 
+				    seed) % n;
+				if (taken[slots[i]])
+					break;
+				for (j = 0; j < i; j++)
+					if (slots[j] == slots[i])
+						break;
+				if (j < i)
+					break;
+			}
+			if (i == m)
+				break;
+		}
+		if (seed == MAX_SEED)
+			errx(1, "no perfect hash found, are paths repeated?");
+		seeds[b] = seed;
+		for (i = 0; i < m; i++)
+		{
+			taken[slots[i]] = 1;
+			docs[members[first[b] + i]].slot = slots[i];
+		}
+	}
+	free(order);
+	free(first);
+	free(members);
+	free(slots);
+	free(taken);
+}
+
+/* Write len bytes, noting where they went /**/
+static uint64_t put(FILE *out, const void *data, size_t len)
+{
+	off_t off;
+
+	if ((off = ftello(out)) == -1 || fwrite(data, 1, len, out) != len)
+		err(1, "write failed");
+	return off;
+}
+
+/* Pad the archive to a multiple of align /**/
+static void align(FILE *out, size_t align)
+{
+	static const char zero[8];
+	off_t off;
+
+	if ((off = ftello(out)) == -1)
+		err(1, "write failed");
+	if (off % align != 0)
+		put(out, zero, align - off % align);
+}
+
+/* Copy the body of file to the archive, it must still be size bytes /**/
+static uint64_t put_body(FILE *out, FILE *file, off_t size, 
+    const char *name)
+{
+	char buf[BUF_SIZE];
+	uint64_t off;
+	off_t left;
+	size_t n;
+
+	if ((off = ftello(out)) == (uint64_t)-1)
+		err(1, "write failed");
+	for (left = size; left > 0; left -= n)
+	{
+		n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), file);
+		if (n == 0)
+			errx(1, "%s changed while packing", name);
+		put(out, buf, n);
+	}
+	if (fgetc(file) != EOF)
+		errx(1, "%s changed while packing", name);
+	return off;
+}
+
+/* Store one coding of a document: header lines, body and validators /**/
+static void put_variant(FILE *out, struct snapvariant *v, FILE *file,
+    const struct fileinfo *fi, const char *name)
+{
+	char hdr[HDR_SIZE];
+	struct buf b;
+
+	/* The status line and Date are added when sending /**/
+	buf_init(&b, hdr, sizeof(hdr));
+	buf_append(&b, "\n", 1);
+	response_fields(&b, NULL, fi->size, fi);
+	buf_append(&b, "\n", 1);
+	v->hdrlen = b.len;
+	v->hdr = put(out, b.data, b.len);
+	v->body = put_body(out, file, fi->size, name);
+	v->size = fi->size;
+	v->present = 1;
+	strlcpy(v->etag, fi->etag, sizeof(v->etag));
+	strlcpy(v->lastmod, fi->lastmod, sizeof(v->lastmod));
+}
+
+/* Write the archive to a temporary file and rename it to name /**/
+static void pack(const char *name)
+{
+	char tmp[PATH_MAX];
+	struct snapheader hdr;
+	struct snapentry *entries, *e;
+	struct fileinfo fi, efi;
+	FILE *out, *file, *efile;
+	uint32_t i;
+	int enc;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", name) >= sizeof(tmp))
+		errx(1, "%s: name too long", name);
+	if ((out = fopen(tmp, "w")) == NULL)
+		err(1, "can't create %s", tmp);
+	if ((entries = calloc(ndocs + 1, sizeof(*entries))) == NULL)
+		err(1, "out of memory");
+	memset(&hdr, 0, sizeof(hdr));
+	put(out, &hdr, sizeof(hdr));
+
+	for (i = 0; i < ndocs; i++)
+	{
+		e = &entries[docs[i].slot];
+		if ((file = fopen(docs[i].file, "r")) == NULL ||
+		    filecache_stat(docs[i].file, fileno(file), &fi) == -1)
+			err(1, "can't read %s", docs[i].file);
+		e->pathlen = strlen(docs[i].path);
+		e->path = put(out, docs[i].path, e->pathlen + 1);
+		e->type = put(out, fi.type, strlen(fi.type) + 1);
+		e->encodings = fi.encodings;
+		put_variant(out, &e->v[ENC_IDENTITY], file, &fi, docs[i].file);
+		fclose(file);
+
+		for (enc = ENC_IDENTITY + 1; enc < ENC_COUNT; enc++)
+		{
+			if ((fi.encodings & ENC_BIT(enc)) == 0)
+				continue;
+			memcpy(&efi, &fi, sizeof(efi));
+			if ((efile = filecache_open_encoded(docs[i].file, enc,
+			    &efi)) == NULL)
+			{
+				e->encodings &= ~ENC_BIT(enc);
+				continue;
+			}
+			put_variant(out, &e->v[enc], efile, &efi, 
+			    docs[i].file);
+			fclose(efile);
+		}
+	}
+
+	align(out, sizeof(uint64_t));
+	hdr.nbuckets = nbuckets;
+	hdr.seeds = put(out, seeds, nbuckets * sizeof(*seeds));
+	align(out, sizeof(uint64_t));
+	hdr.count = ndocs;
+	hdr.entries = put(out, entries, ndocs * sizeof(*entries));
+	memcpy(hdr.magic, SNAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAP_VERSION;
+	if ((hdr.size = ftello(out)) == (uint64_t)-1 || 
+	    fseeko(out, 0, SEEK_SET) == -1)
+		err(1, "write failed");
+	put(out, &hdr, sizeof(hdr));
+	if (fflush(out) == EOF || fsync(fileno(out)) == -1 || 
+	    fclose(out) == EOF)
+		err(1, "write failed");
+	if (rename(tmp, name) == -1)
+		err(1, "can't rename %s to %s", tmp, name);
+	free(entries);
+}
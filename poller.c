@@ -0,0 +1,398 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Event loop readiness.
+ *
+ * Compile using 'gcc -c poller.c' and link poller.o into the server.
+ */
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <err.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "poller.h"
+
+/* Defined Variables /**/
+#define POLLER_SELECT 0
+#define POLLER_EPOLL 1
+#define POLLER_URING 2
+#define POLLER_BATCH 256	/* epoll events taken at once /**/
+#define URING_ENTRIES 1024	/* submission queue size /**/
+#define URING_IGNORE (~0ULL)	/* user data of cancels /**/
+
+/* What an fd waits for /**/
+struct watch
+{
+	int events;
+	void *data;
+	int armed;			/* events of the io_uring poll out /**/
+	int queued;			/* on the io_uring arm list /**/
+	unsigned int gen;		/* io_uring polls of this fd so far /**/
+};
+
+static int kind = -1;
+static struct watch *watches;		/* by fd /**/
+static int nwatches;
+
+/* select() /**/
+static fd_set *rset, *wset;
+static int setsize;
+
+/* epoll /**/
+static int epfd = -1;
+
+/* io_uring, fds to arm on the next wait and the rings /**/
+static int *arm;
+static int narm;
+static int ringfd = -1;
+static struct
+{
+	unsigned int *head, *tail, *mask, *array;
+	unsigned int entries;
+	struct io_uring_sqe *sqes;
+} sq;
+static struct
+{
+	unsigned int *head, *tail, *mask;
+	struct io_uring_cqe *cqes;
+} cq;
+
+/* Make room in the table for fd /**/
+static void poller_grow(int fd)
+{
+	struct watch *w;
+	int *a, n;
+
+	n = nwatches > 0 ? nwatches : 64;
+	while (n <= fd)
+		n *= 2;
+	if ((w = realloc(watches, n * sizeof(*w))) == NULL ||
+	    (a = realloc(arm, n * sizeof(*a))) == NULL)
+		err(1, "poller out of memory");
+	memset(w + nwatches, 0, (n - nwatches) * sizeof(*w));
+	watches = w;
+	arm = a;
+	nwatches = n;
+}
+
+/* Map the rings of a new io_uring /**/
+static void uring_init(void)
+{
+	struct io_uring_params p;
+	size_t size;
+	char *ring;
+
+	memset(&p, 0, sizeof(p));
+	if ((ringfd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) == -1)
+		err(1, "io_uring_setup failed");
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(p.features & IORING_FEAT_EXT_ARG))
+		errx(1, "io_uring is too old for the uring engine");
+	size = MAX(p.sq_off.array + p.sq_entries * sizeof(unsigned int),
+	    p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		err(1, "can't map io_uring");
+	sq.head = (unsigned int *)(ring + p.sq_off.head);
+	sq.tail = (unsigned int *)(ring + p.sq_off.tail);
+	sq.mask = (unsigned int *)(ring + p.sq_off.ring_mask);
+	sq.array = (unsigned int *)(ring + p.sq_off.array);
+	sq.entries = p.sq_entries;
+	cq.head = (unsigned int *)(ring + p.cq_off.head);
+	cq.tail = (unsigned int *)(ring + p.cq_off.tail);
+	cq.mask = (unsigned int *)(ring + p.cq_off.ring_mask);
+	cq.cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+	sq.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd,
+	    IORING_OFF_SQES);
+	if (sq.sqes == MAP_FAILED)
+		err(1, "can't map io_uring");
+}
+
+/*
+ * Submit the queued requests and wait for one completion at most ms
+ * milliseconds, -1 for no limit, when wait is set.
+ /**/
+static int uring_enter(int wait, int ms)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int submit;
+
+	submit = *sq.tail - __atomic_load_n(sq.head, __ATOMIC_ACQUIRE);
+	memset(&arg, 0, sizeof(arg));
+	if (ms >= 0)
+	{
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000L;
+		arg.ts = (__u64)(unsigned long)&ts;
+	}
+	return syscall(__NR_io_uring_enter, ringfd, submit, wait ? 1 : 0,
+	    IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0), 
+	    &arg, sizeof(arg));
+}
+
+/* Queue a poll request, or the cancel of one when op says so /**/
+static void uring_queue(int op, int fd, int events, __u64 data, __u64 addr)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int tail, i;
+
+	/* Full, hand the kernel what is queued /**/
+	tail = *sq.tail;
+	if (tail - __atomic_load_n(sq.head, __ATOMIC_ACQUIRE) == sq.entries &&
+	    uring_enter(0, -1) == -1)
+		err(1, "io_uring_enter failed");
+	i = tail & *sq.mask;
+	sqe = &sq.sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->fd = fd;
+	sqe->poll32_events = (events & POLLER_IN ? POLLIN : 0) |
+	    (events & POLLER_OUT ? POLLOUT : 0);
+	sqe->addr = addr;
+	sqe->user_data = data;
+	sq.array[i] = i;
+	__atomic_store_n(sq.tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* User data of the poll request out for fd /**/
+static __u64 uring_key(int fd)
+{
+	return (__u64)watches[fd].gen << 32 | (unsigned int)fd;
+}
+
+/* Put fd on the list to arm on the next wait /**/
+static void uring_arm(int fd)
+{
+	if (watches[fd].queued)
+		return;
+	watches[fd].queued = 1;
+	arm[narm++] = fd;
+}
+
+/* Pick the backend by name: select, epoll or uring. -1 if unknown /**/
+int poller_init(const char *name)
+{
+	if (strcmp(name, "select") == 0)
+		kind = POLLER_SELECT;
+	else if (strcmp(name, "epoll") == 0)
+	{
+		kind = POLLER_EPOLL;
+		if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+			err(1, "epoll_create1 failed");
+	}
+	else if (strcmp(name, "uring") == 0)
+	{
+		kind = POLLER_URING;
+		uring_init();
+	}
+	else
+		return -1;
+	return 0;
+}
+
+/* Wait for events on fd, 0 for none, handing back data when ready /**/
+void poller_set(int fd, int events, void *data)
+{
+	struct epoll_event ev;
+	struct watch *w;
+	int old, op;
+
+	if (fd >= nwatches)
+		poller_grow(fd);
+	w = &watches[fd];
+	old = w->events;
+	w->events = events;
+	w->data = data;
+	if (kind == POLLER_EPOLL && old != events)
+	{
+		memset(&ev, 0, sizeof(ev));
+		ev.events = (events & POLLER_IN ? EPOLLIN : 0) |
+		    (events & POLLER_OUT ? EPOLLOUT : 0);
+		ev.data.fd = fd;
+		op = old == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL :
+		    EPOLL_CTL_MOD;
+		if (epoll_ctl(epfd, op, fd, &ev) == -1)
+			err(1, "epoll_ctl failed");
+	}
+	else if (kind == POLLER_URING)
+	{
+		/* The poll out waits for something else, cancel it /**/
+		if (w->armed != 0 && w->armed != events)
+		{
+			uring_queue(IORING_OP_POLL_REMOVE, -1, 0, URING_IGNORE,
+			    uring_key(fd));
+			w->armed = 0;
+			w->gen++;
+		}
+		if (events != 0 && w->armed == 0)
+			uring_arm(fd);
+	}
+}
+
+/* Map events the kernel reported to those fd waits for /**/
+static int poller_events(int fd, int in, int out)
+{
+	return ((in ? POLLER_IN : 0) | (out ? POLLER_OUT : 0)) & 
+	    watches[fd].events;
+}
+
+/*
+ * Wait at most ms milliseconds, -1 for no limit, for waited fds to be
+ * ready, and fill ready with up to max of them. Returns how many, or -1
+ * with errno set when interrupted or failed.
+ /**/
+int poller_wait(struct pollready *ready, int max, int ms)
+{
+	struct epoll_event evs[POLLER_BATCH];
+	struct io_uring_cqe *cqe;
+	struct timeval tv;
+	unsigned int head, tail;
+	int fd, maxfd, n, i, ev;
+
+	n = 0;
+	switch (kind)
+	{
+	case POLLER_SELECT:
+		/* Room for every fd, cleared /**/
+		if (nwatches > setsize)
+		{
+			free(rset);
+			free(wset);
+			rset = calloc(howmany(nwatches, NFDBITS), 
+			    sizeof(fd_mask));
+			wset = calloc(howmany(nwatches, NFDBITS), 
+			    sizeof(fd_mask));
+			if (rset == NULL || wset == NULL)
+				err(1, "fd_sets out of memory");
+			setsize = nwatches;
+		}
+		memset(rset, 0, howmany(setsize, NFDBITS) * sizeof(fd_mask));
+		memset(wset, 0, howmany(setsize, NFDBITS) * sizeof(fd_mask));
+		maxfd = -1;
+		for (fd = 0; fd < nwatches; fd++)
+		{
+			if (watches[fd].events & POLLER_IN)
+				FD_SET(fd, rset);
+			if (watches[fd].events & POLLER_OUT)
+				FD_SET(fd, wset);
+			if (watches[fd].events != 0)
+				maxfd = fd;
+		}
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = (ms % 1000) * 1000;
+		if ((i = select(maxfd + 1, rset, wset, NULL, 
+		    ms >= 0 ? &tv : NULL)) <= 0)
+			return i;
+		for (fd = 0; fd <= maxfd && n < max; fd++)
+			if ((ev = poller_events(fd, FD_ISSET(fd, rset), 
+			    FD_ISSET(fd, wset))) != 0)
+			{
+				ready[n].fd = fd;
+				ready[n].events = ev;
+				ready[n++].data = watches[fd].data;
+			}
+		return n;
+
+	case POLLER_EPOLL:
+		if ((i = epoll_wait(epfd, evs, MIN(max, POLLER_BATCH), 
+		    ms)) <= 0)
+			return i;
+		while (i-- > 0)
+		{
+			fd = evs[i].data.fd;
+			if ((ev = poller_events(fd, evs[i].events & (EPOLLIN | 
+			    EPOLLHUP | EPOLLERR), evs[i].events & (EPOLLOUT | 
+			    EPOLLHUP | EPOLLERR))) != 0)
+			{
+				ready[n].fd = fd;
+				ready[n].events = ev;
+				ready[n++].data = watches[fd].data;
+			}
+		}
+		return n;
+
+	case POLLER_URING:
+		/* Arm every fd waited for that has no poll out /**/
+		for (i = 0; i < narm; i++)
+		{
+			fd = arm[i];
+			watches[fd].queued = 0;
+			if (watches[fd].events == 0 || watches[fd].armed != 0)
+				continue;
+			watches[fd].armed = watches[fd].events;
+			uring_queue(IORING_OP_POLL_ADD, fd, 
+			    watches[fd].events, uring_key(fd), 0);
+		}
+		narm = 0;
+		/* Completions left from last time need no waiting /**/
+		head = *cq.head;
+		tail = __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE);
+		if (uring_enter(head == tail, ms) == -1 && errno != ETIME)
+			return -1;
+		tail = __atomic_load_n(cq.tail, __ATOMIC_ACQUIRE);
+		for (; head != tail && n < max; head++)
+		{
+			cqe = &cq.cqes[head & *cq.mask];
+			if (cqe->user_data == URING_IGNORE)
+				continue;
+			fd = cqe->user_data & 0xffffffff;
+			if (fd >= nwatches || watches[fd].armed == 0 ||
+			    (cqe->user_data >> 32) != watches[fd].gen)
+				continue;
+			/* Fired, armed again next time if still waited /**/
+			watches[fd].armed = 0;
+			if (watches[fd].events != 0)
+				uring_arm(fd);
+			if (cqe->res == -ECANCELED)
+				continue;
+			/* Let an error show up on the socket itself /**/
+			if (cqe->res < 0)
+				ev = poller_events(fd, 1, 1);
+			else
+				ev = poller_events(fd, cqe->res & (POLLIN |
+				    POLLHUP | POLLERR), cqe->res & (POLLOUT |
+				    POLLHUP | POLLERR));
+			if (ev != 0)
+			{
+				ready[n].fd = fd;
+				ready[n].events = ev;
+				ready[n++].data = watches[fd].data;
+			}
+		}
+		__atomic_store_n(cq.head, head, __ATOMIC_RELEASE);
+		return n;
+	}
+	errno = EINVAL;
+	return -1;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Readiness of the sockets of an event loop, from select(), epoll or
+ * io_uring poll requests, picked by name at startup.
+ *
+ * Each fd is set to the events it waits for and a pointer, handed back
+ * with the events when it is ready. Readiness is level triggered with
+ * every backend: an fd is reported again as long as it stays ready and
+ * is still waited for. Set an fd to no events before closing it.
+ *
+ * select() rebuilds its fd sets from the table on each wait, epoll only
+ * tells the kernel about changes. io_uring arms a one shot poll request
+ * for each waited fd, and arms it again on the next wait after it
+ * fired; a change of events cancels the armed request, whose completion
+ * is then recognized as stale by the generation in its user data.
+ * There is one poller per process.
+ */
+
+#ifndef POLLER_H
+#define POLLER_H
+
+/* Events waited for /**/
+#define POLLER_IN 1
+#define POLLER_OUT 2
+
+struct pollready
+{
+	int fd;
+	int events;
+	void *data;
+};
+
+int  poller_init(const char *);
+void poller_set(int, int, void *);
+int  poller_wait(struct pollready *, int, int);
+
+#endif /* POLLER_H */
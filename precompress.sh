@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+#  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+# Make pre-compressed sidecars (file.gz, file.br, file.zst) next to each
+# document under a document root, for the servers to send to clients
+# that accept them. Sidecars are only made by the tools that are
+# installed, only for files of at least MINSIZE bytes (default 256), and
+# only kept when smaller than the file. Run again after changing a
+# document; stale sidecars are remade and the servers ignore any sidecar
+# older than its document.
+#
+# Run as ./precompress.sh /some/where/documents [MINSIZE]
+
+if [ $# -lt 1 ] || [ ! -d "$1" ]; then
+	echo "RUN AS: ./precompress.sh /dir/documents [MINSIZE]" >&2
+	exit 1
+fi
+root=$1
+minsize=${2:-256}
+
+# compress SUFFIX COMMAND... : make FILE.SUFFIX from FILE with COMMAND
+compress() {
+	suffix=$1
+	shift
+	command -v "$1" >/dev/null 2>&1 || return 0
+	out="$file$suffix"
+	# Skip up to date sidecars
+	if [ -f "$out" ] && [ ! "$file" -nt "$out" ]; then
+		return 0
+	fi
+	"$@" < "$file" > "$out.tmp" || { rm -f "$out.tmp"; return 0; }
+	if [ "$(wc -c < "$out.tmp")" -lt "$(wc -c < "$file")" ]; then
+		mv "$out.tmp" "$out"
+	else
+		rm -f "$out.tmp" "$out"
+	fi
+}
+
+find "$root" -type f ! -name '*.gz' ! -name '*.br' ! -name '*.zst' \
+    ! -name '*.tmp' -size +$((minsize - 1))c | while IFS= read -r file; do
+	compress .gz gzip -9 -n -c
+	compress .br brotli -q 11 -c
+	compress .zst zstd -19 -q -c
+done
@@ -0,0 +1,244 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Byte-range requests.
+ *
+ * Compile using 'gcc -c range.c' and link range.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "range.h"
+#include "response.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+
+/*
+ * Render the multipart delimiter and headers that come before range i,
+ * or the closing delimiter when i == rs->count, into buf of size bytes.
+ * Returns its length, cut to fit. The body parts use CRLF as multipart
+ * parsers expect it even where header parsers don't.
+ /**/
+size_t range_part(const struct rangeset *rs, int i, char *buf, size_t size)
+{
+	int n;
+
+	if (i == rs->count)
+		n = snprintf(buf, size, "\r\n--%s--\r\n", RANGE_BOUNDARY);
+	else
+		n = snprintf(buf, size, "\r\n--%s\r\nContent-Type: %s\r\n"
+		    "Content-Range: bytes %lld-%lld/%lld\r\n\r\n", 
+		    RANGE_BOUNDARY, rs->type, (long long)rs->r[i].first, 
+		    (long long)rs->r[i].last, (long long)rs->size);
+	return n < size ? n : size - 1;
+}
+
+/*
+ * Parse the value of a Range header for a file of size bytes and
+ * Content-Type type into rs.
+ * Returns the number of ranges to send, 0 if the header should be
+ * ignored and the whole file sent (bad syntax, too many ranges), or -1
+ * if no range can be satisfied and a 416 is due. The value is a slice
+ * of the request head, so it ends at a line ending and no number runs
+ * past it.
+ /**/
+int range_parse(const struct slice *value, off_t size, const char *type,
+    struct rangeset *rs)
+{
+	char part[RANGE_PART];
+	const char *p, *end;
+	char *ep;
+	long long first, last;
+	int specs, i;
+
+	rs->count = 0;
+	rs->size = size;
+	rs->length = 0;
+	rs->type = type;
+	rs->base = 0;
+	if (value->len < 6 || strncasecmp(value->ptr, "bytes=", 6) != 0)
+		return 0;
+
+	specs = 0;
+	p = value->ptr + 6;
+	end = value->ptr + value->len;
+	while (p < end)
+	{
+		/* Skip list separators and blanks /**/
+		if (*p == ',' || *p == ' ' || *p == '\t')
+		{
+			p++;
+			continue;
+		}
+		if (*p == '-')
+		{
+			/* Suffix range, the last n bytes /**/
+			if (!isdigit((unsigned char)p[1]))
+				return 0;
+			last = strtoll(p + 1, &ep, 10);
+			first = size - last;
+			if (first < 0)
+				first = 0;
+			if (last == 0)
+				first = size;
+			last = size - 1;
+		}
+		else
+		{
+			if (!isdigit((unsigned char)*p))
+				return 0;
+			first = strtoll(p, &ep, 10);
+			if (*ep != '-')
+				return 0;
+			p = ep + 1;
+			if (isdigit((unsigned char)*p))
+			{
+				last = strtoll(p, &ep, 10);
+				if (last < first)
+					return 0;
+			}
+			else
+			{
+				last = size - 1;
+				ep = (char *)p;
+			}
+			if (last >= size)
+				last = size - 1;
+		}
+		p = ep;
+		if (p < end && *p != ',' && *p != ' ' && *p != '\t')
+			return 0;
+		specs++;
+
+		/* Keep only ranges that overlap the file /**/
+		if (first >= size)
+			continue;
+		if (rs->count == RANGE_MAX)
+			return 0;
+		rs->r[rs->count].first = first;
+		rs->r[rs->count].last = last;
+		rs->count++;
+	}
+	if (specs == 0)
+		return 0;
+	if (rs->count == 0)
+		return -1;
+
+	/* Work out the body length, parts included /**/
+	if (rs->count == 1)
+		rs->length = rs->r[0].last - rs->r[0].first + 1;
+	else
+		for (i = 0; i <= rs->count; i++)
+		{
+			rs->length += range_part(rs, i, part, sizeof(part));
+			if (i < rs->count)
+				rs->length += rs->r[i].last - rs->r[i].first + 1;
+		}
+	return rs->count;
+}
+
+/*
+ * Append the response header for rs to b: a 206 Partial Content, or a
+ * 416 Range Not Satisfiable when rs holds no ranges. Returns its length.
+ /**/
+size_t range_header(const struct rangeset *rs, const struct fileinfo *fi,
+    struct buf *b)
+{
+	char extra[RANGE_PART];
+
+	if (rs->count == 0)
+	{
+		snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\n",
+		    (long long)rs->size);
+		return response_header(b, "416 Range Not Satisfiable",
+		    NULL, 0, NULL, extra);
+	}
+	if (rs->count == 1)
+	{
+		snprintf(extra, sizeof(extra), 
+		    "Content-Range: bytes %lld-%lld/%lld\n",
+		    (long long)rs->r[0].first, (long long)rs->r[0].last, 
+		    (long long)rs->size);
+		return response_header(b, "206 Partial Content", NULL,
+		    rs->length, fi, extra);
+	}
+	return response_header(b, "206 Partial Content", 
+	    "multipart/byteranges; boundary=" RANGE_BOUNDARY, rs->length,
+	    fi, NULL);
+}
+
+/*
+ * Write the 206 body of rs from fd to the client. Returns the number of
+ * body bytes written, short if a read or write failed.
+ /**/
+off_t range_write(int sd, int fd, const struct rangeset *rs)
+{
+	char buffer[BUF_SIZE];
+	struct iovec iov;
+	off_t total, off, left;
+	ssize_t r;
+	size_t n;
+	int i;
+
+	total = 0;
+	for (i = 0; i <= rs->count; i++)
+	{
+		if (rs->count > 1)
+		{
+			iov.iov_base = buffer;
+			iov.iov_len = range_part(rs, i, buffer, RANGE_PART);
+			if (writev_all(sd, &iov, 1) == -1)
+				return total;
+			total += iov.iov_len;
+		}
+		if (i == rs->count)
+			break;
+
+		off = rs->base + rs->r[i].first;
+		left = rs->r[i].last - rs->r[i].first + 1;
+		while (left > 0)
+		{
+			n = left < BUF_SIZE ? left : BUF_SIZE;
+			r = SYSBYTES(SC_FILE, pread(fd, buffer, n, off));
+			if (r == -1 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				return total;
+			iov.iov_base = buffer;
+			iov.iov_len = r;
+			if (writev_all(sd, &iov, 1) == -1)
+				return total;
+			off += r;
+			left -= r;
+			total += r;
+		}
+	}
+	return total;
+}
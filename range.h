@@ -0,0 +1,65 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Byte-range requests ("Range: bytes=") shared by all three servers.
+ *
+ * A request's ranges are parsed into a rangeset against the file size,
+ * then answered with a 206 Partial Content (multipart/byteranges when
+ * more than one range is asked for) or a 416. The blocking servers read
+ * bodies with pread() at each range's offset, the event loops send them
+ * with sendfile() a part at a time, so the skipped bytes are never read.
+ */
+
+#ifndef RANGE_H
+#define RANGE_H
+
+#include <sys/types.h>
+
+/* Defined Variables /**/
+#define RANGE_MAX 16
+#define RANGE_BOUNDARY "c379a2b0d8f3e5a14c96"
+#define RANGE_PART 256		/* longest delimiter before a part /**/
+
+struct buf;
+struct fileinfo;
+struct slice;
+
+struct range
+{
+	off_t first;		/* first byte of the range /**/
+	off_t last;		/* last byte of the range, inclusive /**/
+};
+
+struct rangeset
+{
+	int count;		/* number of satisfiable ranges /**/
+	off_t size;		/* length of the whole file /**/
+	off_t length;		/* Content-Length of the 206 body /**/
+	const char *type;	/* Content-Type of each part /**/
+	off_t base;		/* offset of the body in the file read /**/
+	struct range r[RANGE_MAX];
+};
+
+int    range_parse(const struct slice *, off_t, const char *,
+           struct rangeset *);
+size_t range_header(const struct rangeset *, const struct fileinfo *,
+           struct buf *);
+size_t range_part(const struct rangeset *, int, char *, size_t);
+off_t  range_write(int, int, const struct rangeset *);
+
+#endif /* RANGE_H */
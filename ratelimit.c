@@ -0,0 +1,180 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per client address limits.
+ *
+ * Compile using 'gcc -c ratelimit.c' and link ratelimit.o into each
+ * server (threads need -lpthread).
+ */
+
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "admission.h"
+#include "ratelimit.h"
+
+/* Defined Variables /**/
+#define RL_TOKEN 1000			/* a token in milli-tokens /**/
+
+struct rlentry
+{
+	in_addr_t addr;			/* client, 0 if the slot is free /**/
+	uint32_t tokens;		/* milli-tokens left /**/
+	uint32_t last;			/* ms clock of the last refill /**/
+	uint32_t conns;			/* connections open /**/
+};
+
+static struct rlentry table[RL_SLOTS];
+static pthread_mutex_t rllock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t rl_rate;		/* tokens a second, 0 is no limit /**/
+static uint32_t rl_burst;		/* bucket size in milli-tokens /**/
+static uint32_t rl_maxconns;		/* 0 is no limit /**/
+static int rl_enabled;
+
+/* Milliseconds of a clock that only moves forward, wraps are fine /**/
+static uint32_t rl_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000u + ts.tv_nsec / 1000000;
+}
+
+/* Slot to start probing at, a multiplicative hash of the address /**/
+static uint32_t rl_hash(in_addr_t addr)
+{
+	return ((uint32_t)addr * 2654435761u) >> (32 - RL_BITS);
+}
+
+/* Add the tokens earned since the last refill /**/
+static void rl_refill(struct rlentry *e, uint32_t now)
+{
+	uint64_t tokens;
+
+	tokens = e->tokens + (uint64_t)(now - e->last) * rl_rate;
+	e->tokens = tokens > rl_burst ? rl_burst : tokens;
+	e->last = now;
+}
+
+/* Check if an entry holds nothing a new address would lose /**/
+static int rl_idle(struct rlentry *e, uint32_t now)
+{
+	if (e->addr == 0)
+		return 1;
+	if (e->conns > 0)
+		return 0;
+	return rl_rate == 0 ||
+	    (uint64_t)(now - e->last) * rl_rate >= rl_burst - e->tokens;
+}
+
+/*
+ * Set the limits of every client address: rate new connections a
+ * second with bursts of up to burst, and at most maxconns open at
+ * once. 0 leaves a limit off; a burst of 0 is one second's worth.
+ /**/
+void ratelimit_init(int rate, int burst, int maxconns)
+{
+	rl_rate = rate;
+	rl_burst = (burst > 0 ? burst : rate) * RL_TOKEN;
+	if (rl_burst < RL_TOKEN)
+		rl_burst = RL_TOKEN;
+	rl_maxconns = maxconns;
+	rl_enabled = rate > 0 || maxconns > 0;
+}
+
+/*
+ * Decide on a connection from client addr. ADMIT_OK counts it open
+ * until ratelimit_leave(); ADMIT_RATE or ADMIT_CLIENT refuse it.
+ /**/
+int ratelimit_check(in_addr_t addr)
+{
+	struct rlentry *e, *free;
+	uint32_t now, i, h;
+	int reason;
+
+	if (!rl_enabled || addr == 0)
+		return ADMIT_OK;
+	now = rl_now();
+	h = rl_hash(addr);
+	e = free = NULL;
+	pthread_mutex_lock(&rllock);
+	for (i = 0; i < RL_PROBE; i++)
+	{
+		e = &table[(h + i) & (RL_SLOTS - 1)];
+		if (e->addr == addr)
+			break;
+		if (free == NULL && rl_idle(e, now))
+			free = e;
+		e = NULL;
+	}
+	if (e == NULL)
+	{
+		/* New address, untracked if every slot near it is busy /**/
+		if ((e = free) == NULL)
+		{
+			pthread_mutex_unlock(&rllock);
+			return ADMIT_OK;
+		}
+		e->addr = addr;
+		e->tokens = rl_burst;
+		e->last = now;
+		e->conns = 0;
+	}
+	rl_refill(e, now);
+
+	reason = ADMIT_OK;
+	if (rl_maxconns > 0 && e->conns >= rl_maxconns)
+		reason = ADMIT_CLIENT;
+	else if (rl_rate > 0 && e->tokens < RL_TOKEN)
+		reason = ADMIT_RATE;
+	else
+	{
+		if (rl_rate > 0)
+			e->tokens -= RL_TOKEN;
+		e->conns++;
+	}
+	pthread_mutex_unlock(&rllock);
+	return reason;
+}
+
+/* A connection ratelimit_check() let through from addr is closed /**/
+void ratelimit_leave(in_addr_t addr)
+{
+	struct rlentry *e;
+	uint32_t i, h;
+
+	if (!rl_enabled || addr == 0)
+		return;
+	h = rl_hash(addr);
+	pthread_mutex_lock(&rllock);
+	for (i = 0; i < RL_PROBE; i++)
+	{
+		e = &table[(h + i) & (RL_SLOTS - 1)];
+		if (e->addr == addr)
+		{
+			if (e->conns > 0)
+				e->conns--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&rllock);
+}
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per client address limits shared by every server engine.
+ *
+ * Each client IPv4 address gets a token bucket, refilled at a set rate
+ * of connections per second up to a burst, and a count of connections
+ * it has open. The buckets live in a fixed open addressing table keyed
+ * by the binary address, 16 bytes an entry, probed over a short run of
+ * neighbouring slots. Nothing is ever swept: an entry whose bucket has
+ * refilled and that holds no connections counts as free and is reused
+ * by the next address that probes past it. When a whole run is busy the
+ * new address is let through untracked rather than refused.
+ *
+ * Checks are made on the accepting side right after accept(), before
+ * the request is read, and refusals are counted by admission control.
+ */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+/* Defined Variables /**/
+#define RL_BITS 12			/* 4096 entries, 64 KB /**/
+#define RL_SLOTS (1 << RL_BITS)
+#define RL_PROBE 8			/* slots looked at per address /**/
+
+void ratelimit_init(int, int, int);
+int  ratelimit_check(in_addr_t);
+void ratelimit_leave(in_addr_t);
+
+#endif /* RATELIMIT_H */
@@ -0,0 +1,333 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Request header helpers.
+ *
+ * Compile using 'gcc -c request.c' and link request.o into each server.
+ */
+
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "encoding.h"
+#include "filecache.h"
+#include "gzcache.h"
+#include "range.h"
+#include "request.h"
+#include "snapshot.h"
+#include "syscount.h"
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+/* Free requests /**/
+static struct request *pool;
+static int pooled;
+static pthread_mutex_t poollock = PTHREAD_MUTEX_INITIALIZER;
+
+/**/
+int request_method(const char *getline)
+{
+	if (strncmp(getline, "GET ", 4) == 0)
+		return METHOD_GET;
+	if (strncmp(getline, "HEAD ", 5) == 0)
+		return METHOD_HEAD;
+	return -1;
+}
+
+/*
+ * Take a request from the pool, or a new one. Neither head nor file is
+ * cleared; head holds len bytes. Returns NULL when out of memory.
+ /**/
+struct request * request_get(void)
+{
+	struct request *r;
+
+	pthread_mutex_lock(&poollock);
+	if ((r = pool) != NULL)
+	{
+		pool = r->next;
+		pooled--;
+	}
+	pthread_mutex_unlock(&poollock);
+	if (r == NULL && (r = malloc(sizeof(*r))) == NULL)
+		return NULL;
+	r->len = 0;
+	r->head[0] = '\0';
+	return r;
+}
+
+/* Give a request back to the pool /**/
+void request_put(struct request *r)
+{
+	pthread_mutex_lock(&poollock);
+	if (pooled < REQ_POOL)
+	{
+		r->next = pool;
+		pool = r;
+		pooled++;
+		r = NULL;
+	}
+	pthread_mutex_unlock(&poollock);
+	free(r);
+}
+
+/* Point t at the next blank separated word of p before end /**/
+static const char * request_word(const char *p, const char *end, 
+    struct slice *t)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	t->ptr = p;
+	while (p < end && *p != ' ' && *p != '\t')
+		p++;
+	t->len = p - t->ptr;
+	return p;
+}
+
+/* Check if slice t holds the string s /**/
+static int request_is(const struct slice *t, const char *s)
+{
+	return t->len == strlen(s) && memcmp(t->ptr, s, t->len) == 0;
+}
+
+/*
+ * Check the request head in buffer and point path at the path its
+ * request line asks for. Returns the method, or -1 unless it is a GET
+ * or HEAD for HTTP/1.1 with From or Host and User-Agent lines.
+ /**/
+int request_parse(const char *buffer, struct slice *path)
+{
+	struct slice method, version, value;
+	const char *p, *end;
+
+	end = buffer + strcspn(buffer, "\r\n");
+	p = request_word(buffer, end, &method);
+	p = request_word(p, end, path);
+	request_word(p, end, &version);
+	if (path->len == 0 || !request_is(&version, "HTTP/1.1"))
+		return -1;
+	if (!request_is(&method, "GET") && !request_is(&method, "HEAD"))
+		return -1;
+
+	/* Check for From or Host and User Agent lines, in any order /**/
+	if ((request_find(buffer, "From", &value) == -1 &&
+	    request_find(buffer, "Host", &value) == -1) ||
+	    request_find(buffer, "User-Agent", &value) == -1)
+		return -1;
+	return request_is(&method, "GET") ? METHOD_GET : METHOD_HEAD;
+}
+
+/*
+ * Find header name in the request head held in buffer and point value
+ * at its value, without leading blanks or the line ending. Returns the
+ * length of the value or -1 if the header is not present.
+ /**/
+int request_find(const char *buffer, const char *name, struct slice *value)
+{
+	const char *line;
+	size_t namelen;
+
+	namelen = strlen(name);
+	/* Skip the request line, stop at the blank line /**/
+	for (line = strchr(buffer, '\n'); line != NULL; 
+	    line = strchr(line, '\n'))
+	{
+		line++;
+		if (*line == '\n' || *line == '\r' || *line == '\0')
+			break;
+		if (strncasecmp(line, name, namelen) != 0 || 
+		    line[namelen] != ':')
+			continue;
+		line += namelen + 1;
+		while (*line == ' ' || *line == '\t')
+			line++;
+		value->ptr = line;
+		value->len = strcspn(line, "\r\n");
+		return value->len;
+	}
+	return -1;
+}
+
+/*
+ * Copy the client a proxy forwarded the request for, the first address
+ * of X-Forwarded-For, into ip. Returns -1 if there is none. Only to be
+ * believed on connections from the local proxy.
+ /**/
+int request_forwarded(const char *buffer, char *ip, size_t size)
+{
+	struct slice value;
+	size_t len;
+
+	if (request_find(buffer, "X-Forwarded-For", &value) == -1)
+		return -1;
+	for (len = 0; len < value.len && value.ptr[len] != ',' &&
+	    value.ptr[len] != ' ' && value.ptr[len] != '\t'; len++)
+		;
+	if (len == 0)
+		return -1;
+	if (len >= size)
+		len = size - 1;
+	memcpy(ip, value.ptr, len);
+	ip[len] = '\0';
+	return 0;
+}
+
+/* Check an If-None-Match list against the entity tag of a file /**/
+static int etag_match(const struct slice *list, const char *etag)
+{
+	const char *p, *end;
+	struct slice tag;
+
+	end = list->ptr + list->len;
+	p = list->ptr;
+	while (p < end)
+	{
+		while (p < end && (*p == ',' || *p == ' ' || *p == '\t'))
+			p++;
+		tag.ptr = p;
+		while (p < end && *p != ',' && *p != ' ' && *p != '\t')
+			p++;
+		tag.len = p - tag.ptr;
+		/* Weak comparison is fine for GET and HEAD /**/
+		if (tag.len > 2 && strncmp(tag.ptr, "W/", 2) == 0)
+		{
+			tag.ptr += 2;
+			tag.len -= 2;
+		}
+		if (tag.len > 0 && (request_is(&tag, "*") || 
+		    request_is(&tag, etag)))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Return 1 if the request carries validators that still match the file,
+ * so a 304 Not Modified can be sent instead of the body. If-None-Match
+ * wins over If-Modified-Since. The date is only compared against the
+ * Last-Modified we sent, which is what clients echo back, so no date
+ * parsing is needed.
+ /**/
+int request_not_modified(const char *buffer, const struct fileinfo *fi)
+{
+	struct slice value;
+
+	if (request_find(buffer, "If-None-Match", &value) != -1)
+		return etag_match(&value, fi->etag);
+	if (request_find(buffer, "If-Modified-Since", &value) != -1)
+		return request_is(&value, fi->lastmod);
+	return 0;
+}
+
+/*
+ * Parse the Range header of a request for the file described by fi.
+ * Returns as range_parse() does; an If-Range that no longer matches the
+ * file means the whole file is sent.
+ /**/
+int request_range(const char *buffer, const struct fileinfo *fi,
+    struct rangeset *rs)
+{
+	struct slice value, ifrange;
+
+	rs->count = 0;
+	if (request_find(buffer, "Range", &value) == -1)
+		return 0;
+	if (request_find(buffer, "If-Range", &ifrange) != -1 && 
+	    !request_is(&ifrange, fi->etag) && 
+	    !request_is(&ifrange, fi->lastmod))
+		return 0;
+	return range_parse(&value, fi->size, fi->type, rs);
+}
+
+/*
+ * Swap file for a pre-compressed sidecar of path when the request's
+ * Accept-Encoding allows one of the codings in fi. Returns the file to
+ * serve, with fi describing it.
+ /**/
+FILE * request_negotiate(const char *buffer, const char *path, FILE *file,
+    struct fileinfo *fi)
+{
+	struct slice value;
+	FILE *efile;
+	int enc;
+
+	if (fi->encodings == 0 || 
+	    request_find(buffer, "Accept-Encoding", &value) == -1)
+		return file;
+	enc = encoding_select(&value, fi->encodings);
+	if (enc == ENC_IDENTITY || 
+	    (efile = filecache_open_encoded(path, enc, fi)) == NULL)
+		return file;
+	SYSCOUNT(SC_CLOSE, fclose(file));
+	return efile;
+}
+
+/*
+ * Find a gzip copy made on the fly for a document no sidecar was chosen
+ * for, when the request takes gzip and is not a range request. On a hit
+ * fi describes the copy and the caller must gzcache_put() it.
+ /**/
+struct gzentry * request_compress(const char *buffer, const char *path,
+    struct fileinfo *fi)
+{
+	struct slice value, range;
+	struct gzentry *e;
+
+	if (!gzcache_eligible(fi))
+		return NULL;
+	/* Some clients may get it compressed, caches must know /**/
+	fi->encodings |= ENC_BIT(ENC_GZIP);
+	if (request_find(buffer, "Range", &range) != -1 ||
+	    request_find(buffer, "Accept-Encoding", &value) == -1 || 
+	    encoding_select(&value, ENC_BIT(ENC_GZIP)) != ENC_GZIP)
+		return NULL;
+	if ((e = gzcache_get(path, fi)) == NULL)
+		return NULL;
+	fi->size = e->len;
+	fi->encoding = ENC_GZIP;
+	strlcpy(fi->etag, e->etag, sizeof(fi->etag));
+	return e;
+}
+
+/*
+ * Find the document at request path in snapshot snap and pick the
+ * coding the request's Accept-Encoding takes. Returns the entry, with
+ * fi describing the chosen coding, or NULL if snap doesn't hold path.
+ /**/
+const struct snapentry * request_snapshot(const char *buffer,
+    struct snapshot *snap, const char *path, struct fileinfo *fi)
+{
+	const struct snapentry *e;
+	struct slice value;
+	int enc;
+
+	if ((e = snapshot_lookup(snap, path)) == NULL)
+		return NULL;
+	enc = ENC_IDENTITY;
+	if (e->encodings != 0 && 
+	    request_find(buffer, "Accept-Encoding", &value) != -1)
+		enc = encoding_select(&value, e->encodings);
+	snapshot_info(snap, e, enc, fi);
+	return e;
+}
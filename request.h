@@ -0,0 +1,81 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Request header helpers shared by every server engine.
+ *
+ * The servers read the whole request head into one NUL terminated
+ * buffer; these helpers look up optional headers in that buffer.
+ * Parsing points slices into the buffer rather than copying, and the
+ * blocking engines keep a request, and the buffer its response is
+ * written through, in a struct request from a pool, so a thread needs
+ * little stack and no buffer is cleared per request.
+ */
+
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <sys/types.h>
+#include <limits.h>
+#include <stdio.h>
+
+#include "buf.h"
+
+struct fileinfo;
+struct gzentry;
+struct rangeset;
+struct snapentry;
+struct snapshot;
+
+/* Request methods /**/
+#define METHOD_GET 0
+#define METHOD_HEAD 1
+
+/* Defined Variables /**/
+#define REQ_HEAD 4096		/* longest request head /**/
+#define REQ_POOL 1024		/* free requests kept for reuse /**/
+#define REQ_OUT 4096		/* response bytes written at a time /**/
+
+/* One request of a blocking engine /**/
+struct request
+{
+	struct request *next;		/* free list of the pool /**/
+	int method;			/* METHOD_GET or METHOD_HEAD /**/
+	size_t len;			/* bytes of head read /**/
+	struct slice path;		/* path asked for, in head /**/
+	char file[PATH_MAX];		/* file name of path /**/
+	char head[REQ_HEAD];		/* request head, NUL terminated /**/
+	char out[REQ_OUT];		/* response header, file chunks /**/
+};
+
+struct request * request_get(void);
+void             request_put(struct request *);
+
+int request_parse(const char *, struct slice *);
+int request_find(const char *, const char *, struct slice *);
+int request_forwarded(const char *, char *, size_t);
+int request_not_modified(const char *, const struct fileinfo *);
+int request_range(const char *, const struct fileinfo *, 
+    struct rangeset *);
+FILE * request_negotiate(const char *, const char *, FILE *, 
+    struct fileinfo *);
+struct gzentry * request_compress(const char *, const char *, 
+    struct fileinfo *);
+const struct snapentry * request_snapshot(const char *, struct snapshot *,
+    const char *, struct fileinfo *);
+
+#endif /* REQUEST_H */
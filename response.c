@@ -0,0 +1,316 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pre-rendered responses and the cached Date header.
+ *
+ * Compile using 'gcc -c response.c' and link response.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "encoding.h"
+#include "filecache.h"
+#include "response.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define DATE_SIZE 80
+#define XSTR(x) #x
+#define STR(x) XSTR(x)
+
+struct canned
+{
+	const char *status;	/* status line text, also used in the log /**/
+	const char *body;	/* html body sent to the client /**/
+	const char *extra;	/* further header lines, or NULL /**/
+	char *head;		/* status line and "Date: " /**/
+	char *tail;		/* remaining headers and the body /**/
+	size_t headlen;
+	size_t taillen;
+};
+
+static struct canned canned[RESP_COUNT] = {
+	{ "400 Bad Request",
+	  "<html><body>\n<h2>Malformed Request</h2>\n"
+	  "Your browser sent a request I could not understand.\n"
+	  "</body></html>" },
+	{ "403 Forbidden",
+	  "<html><body>\n<h2>Permission Denied</h2>\n"
+	  "You asked for a document you are not permitted to see. "
+	  "It sucks to be you.\n</body></html>" },
+	{ "404 Not Found",
+	  "<html><body>\n<h2>Document not found</h2>\n"
+	  "You asked for a document that doesn't exist. "
+	  "That is so sad.\n</body></html>" },
+	{ "500 Internal Server Error",
+	  "<html><body>\n<h2>Oops. That didn't work</h2>\n"
+	  "I had some sort of problem dealing with your request. "
+	  "Sorry, I'm lame.\n</body></html>" },
+	{ "503 Service Unavailable",
+	  "<html><body>\n<h2>Too busy</h2>\n"
+	  "I have more clients than I can handle right now. "
+	  "Please try again in a moment.\n</body></html>",
+	  "Retry-After: " STR(RETRY_AFTER) "\n" },
+	{ "429 Too Many Requests",
+	  "<html><body>\n<h2>Slow down</h2>\n"
+	  "You are sending me more than your share of requests.\n"
+	  "</body></html>",
+	  "Retry-After: " STR(RETRY_AFTER) "\n" },
+};
+
+/* Content-Type by file name extension /**/
+static const char *types[][2] = {
+	{ ".html", "text/html" },
+	{ ".htm", "text/html" },
+	{ ".txt", "text/plain" },
+	{ ".css", "text/css" },
+	{ ".js", "application/javascript" },
+	{ ".json", "application/json" },
+	{ ".xml", "application/xml" },
+	{ ".png", "image/png" },
+	{ ".jpg", "image/jpeg" },
+	{ ".jpeg", "image/jpeg" },
+	{ ".gif", "image/gif" },
+	{ ".svg", "image/svg+xml" },
+	{ ".ico", "image/x-icon" },
+	{ ".pdf", "application/pdf" },
+	{ ".gz", "application/gzip" },
+	{ ".zst", "application/zstd" },
+	{ ".br", "application/octet-stream" },
+	{ ".tar", "application/x-tar" },
+	{ ".zip", "application/zip" },
+	{ NULL, NULL }
+};
+
+/* Render every canned response once, before accepting clients /**/
+void response_init(void)
+{
+	struct buf head, tail;
+	int i;
+
+	for (i = 0; i < RESP_COUNT; i++)
+	{
+		struct canned *c = &canned[i];
+
+		/* Each keeps the storage of its buffers /**/
+		buf_init(&head, NULL, 0);
+		buf_init(&tail, NULL, 0);
+		if (buf_printf(&head, "HTTP/1.1 %s\nDate: ", c->status) 
+		    == -1 || buf_printf(&tail, "\nContent-Type: text/html\n"
+		    "Content-Length: %zu\n%s\n%s", strlen(c->body), 
+		    c->extra != NULL ? c->extra : "", c->body) == -1)
+			err(1, "response_init failed");
+		c->head = head.data;
+		c->headlen = head.len;
+		c->tail = tail.data;
+		c->taillen = tail.len;
+	}
+}
+
+/*
+ * Return the current Date string, only re-rendered when the second
+ * changes. Each thread keeps its own copy so threads need no lock.
+ /**/
+const char * response_date(size_t *len)
+{
+	static __thread char date[DATE_SIZE];
+	static __thread size_t datelen;
+	static __thread time_t last = -1;
+	time_t now;
+
+	now = time(NULL);
+	if (now != last)
+	{
+		datelen = strftime(date, sizeof(date), "%a, %d %b %Y %X %Z",
+		    localtime(&now));
+		last = now;
+	}
+	if (len != NULL)
+		*len = datelen;
+	return date;
+}
+
+/* Content-Type of the file at path, text/html when not known /**/
+const char * response_type(const char *path)
+{
+	const char *ext;
+	int i;
+
+	if ((ext = strrchr(path, '.')) == NULL || strchr(ext, '/') != NULL)
+		return "text/html";
+	for (i = 0; types[i][0] != NULL; i++)
+		if (strcasecmp(ext, types[i][0]) == 0)
+			return types[i][1];
+	return "text/html";
+}
+
+/* Status line text of a canned response, ie) "404 Not Found" /**/
+const char * response_status(int resp)
+{
+	return canned[resp].status;
+}
+
+/*
+ * Point iov[0..RESP_IOVCNT-1] at a canned response and return its total
+ * length. The iovecs reference shared memory and must not be modified.
+ /**/
+size_t response_iov(int resp, struct iovec *iov)
+{
+	struct canned *c = &canned[resp];
+	size_t datelen;
+
+	iov[0].iov_base = c->head;
+	iov[0].iov_len = c->headlen;
+	iov[1].iov_base = (char *)response_date(&datelen);
+	iov[1].iov_len = datelen;
+	iov[2].iov_base = c->tail;
+	iov[2].iov_len = c->taillen;
+	return c->headlen + datelen + c->taillen;
+}
+
+/*
+ * Drop the first n bytes from iov, moving what is left to the front of
+ * the array. Return the number of iovecs still holding data.
+ /**/
+int iov_advance(struct iovec *iov, int iovcnt, size_t n)
+{
+	int i;
+
+	for (i = 0; i < iovcnt && n >= iov[i].iov_len; i++)
+		n -= iov[i].iov_len;
+	if (i > 0)
+		memmove(iov, iov + i, (iovcnt - i) * sizeof(*iov));
+	iovcnt -= i;
+	if (iovcnt > 0)
+	{
+		iov[0].iov_base = (char *)iov[0].iov_base + n;
+		iov[0].iov_len -= n;
+	}
+	return iovcnt;
+}
+
+/*
+ * Undo what was appended to b since start if cut, so a header is sent
+ * whole or not at all. Returns the length appended, 0 if undone.
+ /**/
+static size_t response_done(struct buf *b, size_t start, int cut)
+{
+	if (!cut)
+		return b->len - start;
+	b->len = start;
+	if (b->cap > start)
+		b->data[start] = '\0';
+	return 0;
+}
+
+/* Append the lines of response_fields(), return 1 if any was cut /**/
+static int response_entity(struct buf *b, const char *type, off_t length,
+    const struct fileinfo *fi)
+{
+	int cut = 0;
+
+	if (type == NULL)
+		type = fi != NULL ? fi->type : "text/html";
+	if (length >= 0)
+		cut |= buf_printf(b, "Content-Type: %s\nContent-Length: "
+		    "%lld\n", type, (long long)length) == -1;
+	if (fi != NULL)
+		cut |= buf_printf(b, "ETag: %s\nLast-Modified: %s\n", 
+		    fi->etag, fi->lastmod) == -1;
+	if (fi != NULL && fi->encoding != ENC_IDENTITY)
+		cut |= buf_printf(b, "Content-Encoding: %s\n", 
+		    encoding_name(fi->encoding)) == -1;
+	if (fi != NULL && fi->encodings != 0)
+		cut |= buf_printf(b, "Vary: Accept-Encoding\n") == -1;
+	return cut;
+}
+
+/*
+ * Append the entity header lines of a document to b: Content-Type and
+ * Content-Length unless length is -1, then the validators and coding
+ * headers of fi when not NULL. type is as for response_header().
+ * Returns the length appended, 0 with nothing appended if b couldn't
+ * take all of it.
+ /**/
+size_t response_fields(struct buf *b, const char *type, off_t length, 
+    const struct fileinfo *fi)
+{
+	size_t start = b->len;
+
+	return response_done(b, start, response_entity(b, type, length, fi));
+}
+
+/*
+ * Append the header of a document response to b, ie) for status
+ * "200 OK". type overrides the Content-Type of fi (text/html without
+ * either). length is the Content-Length, or -1 to leave out the entity
+ * headers as a 304 does. fi adds the cached validators and coding
+ * headers and extra any further header lines when not NULL. Returns
+ * the header length, 0 with nothing appended if b couldn't take it.
+ /**/
+size_t response_header(struct buf *b, const char *status, 
+    const char *type, off_t length, const struct fileinfo *fi, 
+    const char *extra)
+{
+	size_t start = b->len;
+	size_t datelen;
+	const char *date;
+	int cut = 0;
+
+	date = response_date(&datelen);
+	cut |= buf_printf(b, "HTTP/1.1 %s\nDate: ", status) == -1;
+	cut |= buf_append(b, date, datelen) == -1;
+	cut |= buf_append(b, "\n", 1) == -1;
+	cut |= response_entity(b, type, length, fi);
+	if (extra != NULL)
+		cut |= buf_append(b, extra, strlen(extra)) == -1;
+	cut |= buf_append(b, "\n", 1) == -1;
+	return response_done(b, start, cut);
+}
+
+/* Write every iovec to the client, return bytes written or -1 /**/
+ssize_t writev_all(int sd, struct iovec *iov, int iovcnt)
+{
+	ssize_t written, w;
+
+	written = 0;
+	while (iovcnt > 0)
+	{
+		w = SYSBYTES(SC_WRITE, writev(sd, iov, iovcnt));
+		if (w == -1)
+		{
+			if (errno != EINTR)
+				return -1;
+			continue;
+		}
+		written += w;
+		iovcnt = iov_advance(iov, iovcnt, w);
+	}
+	return written;
+}
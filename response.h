@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pre-rendered responses shared by every server engine.
+ *
+ * Every canned response is built once by response_init() and split into
+ * a head ("HTTP/1.1 404 Not Found\nDate: ") and a tail (the remaining
+ * headers and the body). Sending one is a writev() of head, the cached
+ * Date and tail, so no bytes are copied or allocated per request.
+ */
+
+#ifndef RESPONSE_H
+#define RESPONSE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Canned responses /**/
+#define RESP_BAD_REQUEST 0
+#define RESP_FORBIDDEN 1
+#define RESP_NOT_FOUND 2
+#define RESP_INTERNAL_SERVER_ERROR 3
+#define RESP_SERVICE_UNAVAILABLE 4
+#define RESP_TOO_MANY_REQUESTS 5
+#define RESP_COUNT 6
+
+/* Seconds a client refused with a 503 or 429 is told to wait /**/
+#define RETRY_AFTER 1
+
+/* Number of iovecs needed to send a canned response /**/
+#define RESP_IOVCNT 3
+
+/* Room for a rendered response header /**/
+#define HDR_SIZE 1024
+
+struct buf;
+struct fileinfo;
+
+void         response_init(void);
+const char * response_date(size_t *);
+const char * response_status(int);
+const char * response_type(const char *);
+size_t       response_iov(int, struct iovec *);
+size_t       response_fields(struct buf *, const char *, off_t,
+                 const struct fileinfo *);
+size_t       response_header(struct buf *, const char *, const char *,
+                 off_t, const struct fileinfo *, const char *);
+int          iov_advance(struct iovec *, int, size_t);
+ssize_t      writev_all(int, struct iovec *, int);
+
+#endif /* RESPONSE_H */
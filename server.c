@@ -0,0 +1,617 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Copyright (c) 2008 Bob Beck <beck@obtuse.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ */
+
+/*
+ * Web server with a choice of concurrency engines, see engine.h.
+ *
+ * Compile with 'make server', or 'make all' for it and server_f,
+ * server_p and server_s, the same program defaulting to the fork,
+ * thread (pool with -w) and select engines.
+ *
+ * Run as ./server [--engine=name] [-a snapshot] [-z level] 8000
+ *     /some/where/documents /some/where/logfile
+ * where 8000 is the port number,
+ * /some/where/documents is the directory of html files, and
+ * /some/where/logfile is the log file.
+ * --engine is one of fork, prefork, thread, pool, select, epoll or
+ * uring, epoll by default. -a serves the documents packed in snapshot
+ * by mksnapshot first, SIGHUP loads it again. -z gzips text documents
+ * on the fly for the thread and event engines. -w is the number of
+ * pool threads or prefork processes, one per CPU by default, and -d
+ * how the pool places connections: round robin (rr), least loaded
+ * (least, the default) or one shared queue (shared). -n runs that many
+ * event loops, each pinned to its own CPU with its own listening
+ * socket, connections, caches and log buffer; 0 runs one for every
+ * CPU. -U also listens on a Unix domain socket, shared by every
+ * process. -C caps the connections open in one process, by default
+ * half the open file limit, and -M the bytes of bodies it caches, by
+ * default its share of a sixteenth of memory. -f reads options from a
+ * config file of "name value" lines, see config.h; flags override it.
+ * -K sets the stack of the threads serving requests, 64KB by default.
+ * -G caps the bytes held in buffers, caches and stacks, by default the
+ * process's share of half of memory; near it the server stops
+ * accepting, shrinks its caches and sends bodies from their files.
+ * The effective values are printed at startup and on the status page.
+ * SIGUSR1 writes the most requested paths and busiest clients to
+ * logfile.hot. "-Y on" counts the I/O calls each request makes, by
+ * phase and status, on the status page. -R keeps that many turns of
+ * each event loop, written to logfile.trace as Chrome trace events on
+ * SIGUSR2.
+ */
+
+/* sched_setaffinity() /**/
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "admission.h"
+#include "config.h"
+#include "core.h"
+#include "doccache.h"
+#include "engine.h"
+#include "gzcache.h"
+#include "hotpath.h"
+#include "listener.h"
+#include "logfile.h"
+#include "looptrace.h"
+#include "memory.h"
+#include "ratelimit.h"
+#include "response.h"
+#include "shmcache.h"
+#include "snapshot.h"
+#include "syscount.h"
+#include "transmit.h"
+
+/* Engine run without --engine /**/
+#ifndef ENGINE
+#define ENGINE "epoll"
+#endif
+
+/* Defined Variables /**/
+#define OPTIONS "B:C:D:F:G:K:L:M:R:S:T:U:Y:a:b:c:d:f:l:m:n:q:r:w:z:"
+#define FILES_SPARE 64		/* descriptors kept for listeners, logs /**/
+#define CONN_MEMORY (256 * 1024) /* memory one connection may take /**/
+#define CONN_MIN 16		/* default connections at the least /**/
+#define CACHE_SHARE 16		/* bodies cached in 1/16 of memory /**/
+#define CACHE_MIN (4 * 1024 * 1024)
+#define MEMORY_SHARE 2		/* buffers, caches, stacks in 1/2 /**/
+#define MEMORY_MIN (16 * 1024 * 1024)
+
+/* Function Prototypes /**/
+static void set_option(int, char *);
+static void handle_signal(int);
+static void usage(void);
+
+struct engine
+{
+	const char *name;
+	int model;
+	void (*run)(struct engineconf *);
+};
+
+static const struct engine engines[] = {
+	{ "fork", ENGINE_PROCESS, fork_run },
+	{ "prefork", ENGINE_PROCESS, prefork_run },
+	{ "thread", ENGINE_THREAD, thread_run },
+	{ "pool", ENGINE_THREAD, pool_run },
+	{ "select", ENGINE_EVENT, event_run },
+	{ "epoll", ENGINE_EVENT, event_run },
+	{ "uring", ENGINE_EVENT, event_run },
+	{ NULL }
+};
+
+/* Long flags, also the option names of a config file /**/
+static const struct option longopts[] = {
+	{ "engine", required_argument, NULL, 'E' },
+	{ "config", required_argument, NULL, 'f' },
+	{ "backlog", required_argument, NULL, 'B' },
+	{ "max-conn", required_argument, NULL, 'C' },
+	{ "defer-accept", required_argument, NULL, 'D' },
+	{ "fastopen", required_argument, NULL, 'F' },
+	{ "mem-limit", required_argument, NULL, 'G' },
+	{ "stack", required_argument, NULL, 'K' },
+	{ "lowat", required_argument, NULL, 'L' },
+	{ "cache", required_argument, NULL, 'M' },
+	{ "trace", required_argument, NULL, 'R' },
+	{ "sndbuf", required_argument, NULL, 'S' },
+	{ "tx", required_argument, NULL, 'T' },
+	{ "unix", required_argument, NULL, 'U' },
+	{ "syscalls", required_argument, NULL, 'Y' },
+	{ "snapshot", required_argument, NULL, 'a' },
+	{ "burst", required_argument, NULL, 'b' },
+	{ "per-client", required_argument, NULL, 'c' },
+	{ "dist", required_argument, NULL, 'd' },
+	{ "latency", required_argument, NULL, 'l' },
+	{ "max-inflight", required_argument, NULL, 'm' },
+	{ "cores", required_argument, NULL, 'n' },
+	{ "max-queue", required_argument, NULL, 'q' },
+	{ "rate", required_argument, NULL, 'r' },
+	{ "workers", required_argument, NULL, 'w' },
+	{ "gzip", required_argument, NULL, 'z' },
+	{ NULL }
+};
+
+volatile sig_atomic_t reload;
+volatile sig_atomic_t dump;
+volatile sig_atomic_t dumptrace;
+
+/* Options, from flags or the config file /**/
+static struct engineconf conf;
+static const char *name;
+static char *unixpath;
+static int backlog, defer, fastopen;
+
+int main(int argc, char *argv[])
+{
+	const struct engine *e;
+	struct engineconf *c = &conf;
+	struct sigaction sa;
+	char hotfile[PATH_MAX], tracefile[PATH_MAX];
+	size_t memory;
+	int ch, cpus, files, loops;
+
+	c->sd = -1;
+	c->usd = -1;
+	c->txpolicy = TX_NONE;
+	c->dist = DIST_LEAST;
+	c->cores = -1;
+
+	/* Read the config file first, flags override what it says /**/
+	opterr = 0;
+	while ((ch = getopt_long(argc, argv, OPTIONS, longopts, NULL)) != -1)
+		if (ch == 'f')
+			config_load(optarg, longopts, set_option);
+	opterr = 1;
+	optind = 0;
+	while ((ch = getopt_long(argc, argv, OPTIONS, longopts, NULL)) != -1)
+		if (ch != 'f')
+			set_option(ch, optarg);
+	argc -= optind;
+	argv += optind;
+	if (argc != 3)
+		usage();
+
+	/* server_p -w has always been its worker pool /**/
+	if (name == NULL)
+		name = strcmp(ENGINE, "thread") == 0 && c->workers > 0 ? 
+		    "pool" : ENGINE;
+	for (e = engines; e->name != NULL; e++)
+		if (strcmp(e->name, name) == 0)
+			break;
+	if (e->name == NULL)
+		errx(1, "engine must be fork, prefork, thread, pool, select, "
+		    "epoll or uring");
+	c->engine = e->name;
+	c->model = e->model;
+
+	/*
+	 * What wasn't given is sized to the host: a connection needs a
+	 * descriptor for its socket and one for a file, workers one CPU
+	 * each, and every process caches in its share of memory.
+	 /**/
+	cpus = config_cpus();
+	files = config_files();
+	memory = config_memory();
+	if (c->maxconn == 0)
+	{
+		c->maxconn = (files - FILES_SPARE) / 2;
+		if ((size_t)c->maxconn > memory / CONN_MEMORY)
+			c->maxconn = memory / CONN_MEMORY;
+		if (c->maxconn < CONN_MIN)
+			c->maxconn = CONN_MIN;
+	}
+	if (c->maxinflight == 0 || c->maxinflight > c->maxconn)
+		c->maxinflight = c->maxconn;
+	if (c->workers == 0)
+		c->workers = cpus;
+	if (c->workers > c->maxconn)
+		c->workers = c->maxconn;
+	if (c->stack == 0)
+		c->stack = ENGINE_STACK;
+	if (c->stack < PTHREAD_STACK_MIN)
+		c->stack = PTHREAD_STACK_MIN;
+	loops = c->cores == 0 || c->cores > cpus ? cpus : 
+	    c->cores < 0 ? 1 : c->cores;
+	if (c->cache == 0)
+	{
+		c->cache = memory / CACHE_SHARE / loops;
+		if (c->cache < CACHE_MIN)
+			c->cache = CACHE_MIN;
+	}
+	if (c->memlimit == 0)
+	{
+		c->memlimit = memory / MEMORY_SHARE / loops;
+		if (c->memlimit < MEMORY_MIN)
+			c->memlimit = MEMORY_MIN;
+	}
+
+	/* Send arguments to variables /**/
+	c->port = listener_port(argv[0]);
+	c->documents = argv[1];
+	logfile_init(argv[2]);
+	/* Counted by every process, dumped next to the log /**/
+	snprintf(hotfile, sizeof(hotfile), "%s.hot", argv[2]);
+	hotpath_init(hotfile);
+	snprintf(tracefile, sizeof(tracefile), "%s.trace", argv[2]);
+	looptrace_init(c->model == ENGINE_EVENT ? c->trace : 0, tracefile);
+
+	/* The Unix domain socket is one for every process /**/
+	backlog = listener_init(backlog, defer, fastopen);
+	if (unixpath != NULL)
+		c->usd = listener_unix(unixpath);
+
+	config_report("engine", "%s", c->engine);
+	config_report("cpus", "%d", cpus);
+	config_report("files", "%d", files);
+	config_report("memory", "%zu", memory);
+	config_report("max_conn", "%d", c->maxconn);
+	config_report("max_inflight", "%d", c->maxinflight);
+	if (strcmp(c->engine, "pool") == 0 || 
+	    strcmp(c->engine, "prefork") == 0)
+		config_report("workers", "%d", c->workers);
+	if (c->model == ENGINE_THREAD)
+		config_report("stack", "%zu", c->stack);
+	if (c->model == ENGINE_EVENT)
+		config_report("loops", "%d", loops);
+	config_report("backlog", "%d", backlog);
+	config_report("cache", "%zu", c->cache);
+	if (c->gzip_level > 0 && c->model != ENGINE_PROCESS)
+		config_report("gzip_cache", "%zu", c->cache / 2);
+	config_report("mem_limit", "%zu", c->memlimit);
+	if (c->syscalls)
+		config_report("syscalls", "on");
+	if (c->trace > 0 && c->model == ENGINE_EVENT)
+		config_report("trace", "%d", c->trace);
+	config_print();
+
+	if (daemon(1, 0) == -1)
+		err(1, "daemon() failed");
+
+	/*
+	 * SIGHUP reloads the snapshot, SIGUSR1 dumps the hot paths and
+	 * SIGUSR2 the event loop trace. They stay blocked until the
+	 * engine waits for connections, so helper threads never take
+	 * them.
+	 /**/
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if (sigaction(SIGHUP, &sa, NULL) == -1 || 
+	    sigaction(SIGUSR1, &sa, NULL) == -1 ||
+	    sigaction(SIGUSR2, &sa, NULL) == -1)
+		err(1, "sigaction failed");
+	sigemptyset(&c->hup);
+	sigaddset(&c->hup, SIGHUP);
+	sigaddset(&c->hup, SIGUSR1);
+	sigaddset(&c->hup, SIGUSR2);
+	sigprocmask(SIG_BLOCK, &c->hup, NULL);
+
+	e->run(c);
+	return 0;
+}
+
+/* Set the option of flag ch to arg, from the command line or config /**/
+static void set_option(int ch, char *arg)
+{
+	struct engineconf *c = &conf;
+	char *ep;
+
+	switch (ch)
+	{
+	case 'E':
+		name = arg;
+		break;
+	case 'f':
+		errx(1, "a config file can't name another");
+	case 'B':
+		/* accept queue length, 0 for somaxconn /**/
+		backlog = admission_limit(arg);
+		break;
+	case 'C':
+		/* connections open in one process, 0 to size it /**/
+		c->maxconn = admission_limit(arg);
+		break;
+	case 'D':
+		/* hold connections until their request arrives /**/
+		defer = admission_limit(arg);
+		break;
+	case 'F':
+		/* TCP fast open queue length /**/
+		fastopen = admission_limit(arg);
+		break;
+	case 'G':
+		/* ceiling of the memory budget, 0 to size it /**/
+		c->memlimit = config_size(arg);
+		break;
+	case 'K':
+		/* stack of a thread serving requests, 0 for the default /**/
+		c->stack = config_size(arg);
+		break;
+	case 'L':
+		/* unsent bytes the kernel holds, TCP_NOTSENT_LOWAT /**/
+		c->lowat = admission_limit(arg);
+		break;
+	case 'M':
+		/* bytes of cached bodies in one process, 0 to size it /**/
+		c->cache = config_size(arg);
+		break;
+	case 'R':
+		/* turns of each event loop kept for SIGUSR2, 0 is off /**/
+		c->trace = admission_limit(arg);
+		break;
+	case 'S':
+		/* send buffer sized to each response, up to this /**/
+		c->sndbuf = admission_limit(arg);
+		break;
+	case 'T':
+		/* none, cork or nodelay /**/
+		c->txpolicy = transmit_policy(arg);
+		break;
+	case 'U':
+		/* also listen on this Unix domain socket /**/
+		unixpath = arg;
+		break;
+	case 'Y':
+		/* on to count the I/O calls of every request /**/
+		c->syscalls = syscount_mode(arg);
+		break;
+	case 'a':
+		c->snapshot = arg;
+		break;
+	case 'l':
+		/* refuse while requests average over this many ms /**/
+		c->maxlatency = admission_limit(arg);
+		break;
+	case 'm':
+		/* refuse over this many connections in flight /**/
+		c->maxinflight = admission_limit(arg);
+		break;
+	case 'n':
+		/* event loops pinned one per CPU, 0 for every CPU /**/
+		c->cores = admission_limit(arg);
+		break;
+	case 'q':
+		/* refuse over this many waiting to be accepted /**/
+		c->maxqueue = admission_limit(arg);
+		break;
+	case 'r':
+		/* new connections a second from one client /**/
+		c->rate = admission_limit(arg);
+		break;
+	case 'b':
+		/* burst of connections over the rate /**/
+		c->burst = admission_limit(arg);
+		break;
+	case 'c':
+		/* connections open at once from one client /**/
+		c->perclient = admission_limit(arg);
+		break;
+	case 'd':
+		/* how the pool acceptor picks a worker /**/
+		if (strcmp(arg, "rr") == 0)
+			c->dist = DIST_RR;
+		else if (strcmp(arg, "least") == 0)
+			c->dist = DIST_LEAST;
+		else if (strcmp(arg, "shared") == 0)
+			c->dist = DIST_SHARED;
+		else
+			errx(1, "distribution must be rr, least or shared");
+		break;
+	case 'w':
+		/* pool threads or prefork processes, 0 for one per CPU /**/
+		c->workers = admission_limit(arg);
+		break;
+	case 'z':
+		/* gzip level for on the fly compression, 0 is off /**/
+		c->gzip_level = strtol(arg, &ep, 10);
+		if (*arg == '\0' || *ep != '\0' || 
+		    c->gzip_level < 0 || c->gzip_level > 9)
+			errx(1, "gzip level must be 0 to 9");
+		break;
+	default:
+		usage();
+	}
+}
+
+/*
+ * Set up what a process serves from: the canned responses, counters
+ * and limits, the caches its engine shares and the snapshot, then
+ * listen on the port, steered to cpu unless it is -1.
+ /**/
+void engine_setup(struct engineconf *c, int cpu)
+{
+	/* Charge from the start, then render the canned responses /**/
+	memory_init(c->memlimit);
+	response_init();
+	admission_init(c->maxinflight, c->maxqueue, c->maxlatency);
+	ratelimit_init(c->rate, c->burst, c->perclient);
+	transmit_init(c->txpolicy, c->sndbuf, c->lowat);
+	syscount_init(c->syscalls);
+	switch (c->model)
+	{
+	case ENGINE_PROCESS:
+		/* Map the cache all children share /**/
+		shmcache_init(c->cache);
+		break;
+	case ENGINE_THREAD:
+		/* Threads wait on each other's loads, no loader thread /**/
+		gzcache_init(c->gzip_level, c->cache / 2);
+		doccache_init(0, c->cache);
+		break;
+	default:
+		/* Load bodies on a thread, off the event loop /**/
+		gzcache_init(c->gzip_level, c->cache / 2);
+		doccache_init(1, c->cache);
+		break;
+	}
+	core_init(c->documents, c->model == ENGINE_PROCESS);
+	/* Map the snapshot, children and threads share its pages /**/
+	if (c->snapshot != NULL && snapshot_init(c->snapshot) == -1)
+		errx(1, "can't load snapshot %s", c->snapshot);
+	c->sd = listener_open(c->port, cpu);
+}
+
+/*
+ * Fork n processes, one for every CPU this process may run on when n
+ * is 0, each pinned to its own CPU when pin is set. Returns the CPU in
+ * each child, or its number when not pinned. The parent stays to pass
+ * SIGHUP on and start a process again if one dies, and never returns.
+ /**/
+int engine_spawn(int n, int pin, sigset_t *hup)
+{
+	cpu_set_t avail, set;
+	pid_t pids[CPU_SETSIZE], pid;
+	int cpus[CPU_SETSIZE];
+	int cpu, count, i;
+
+	if (sched_getaffinity(0, sizeof(avail), &avail) == -1)
+		err(1, "sched_getaffinity failed");
+	if (n == 0 || n > CPU_SETSIZE)
+		n = n == 0 ? CPU_COUNT(&avail) : CPU_SETSIZE;
+	count = 0;
+	for (cpu = 0; cpu < CPU_SETSIZE && count < n; cpu++)
+		if (CPU_ISSET(cpu, &avail))
+			cpus[count++] = cpu;
+	/* No more pinned processes than CPUs /**/
+	if (pin)
+		n = count;
+	for (i = 0; i < n; i++)
+		pids[i] = 0;
+
+	while (1)
+	{
+		/* Start every process that isn't running /**/
+		for (i = 0; i < n; i++)
+		{
+			if (pids[i] != 0)
+				continue;
+			if ((pid = fork()) == -1)
+				err(1, "fork failed");
+			if (pid == 0)
+			{
+				prctl(PR_SET_PDEATHSIG, SIGTERM);
+				if (!pin)
+					return i;
+				CPU_ZERO(&set);
+				CPU_SET(cpus[i], &set);
+				if (sched_setaffinity(0, sizeof(set), &set) 
+				    == -1)
+					err(1, "sched_setaffinity failed");
+				return cpus[i];
+			}
+			pids[i] = pid;
+		}
+
+		sigprocmask(SIG_UNBLOCK, hup, NULL);
+		pid = wait(NULL);
+		sigprocmask(SIG_BLOCK, hup, NULL);
+		if (reload)
+		{
+			reload = 0;
+			for (i = 0; i < n; i++)
+				kill(pids[i], SIGHUP);
+		}
+		/* Each event loop writes its own trace /**/
+		if (dumptrace)
+		{
+			dumptrace = 0;
+			for (i = 0; i < n; i++)
+				kill(pids[i], SIGUSR2);
+		}
+		/* Every process counts into the summary this one dumps /**/
+		if (dump)
+		{
+			dump = 0;
+			hotpath_dump();
+		}
+		if (pid == -1)
+			continue;
+		for (i = 0; i < n; i++)
+			if (pids[i] == pid)
+				pids[i] = 0;
+		/* Don't spin if a process dies at once /**/
+		sleep(1);
+	}
+}
+
+/*
+ * Act on the signals noted since the engine last waited: reload the
+ * snapshot on SIGHUP, a bad one leaves the old, write the hot paths
+ * on SIGUSR1 and the event loop trace on SIGUSR2.
+ /**/
+void engine_signalled(void)
+{
+	if (reload)
+	{
+		reload = 0;
+		snapshot_reload();
+	}
+	if (dump)
+	{
+		dump = 0;
+		hotpath_dump();
+	}
+	if (dumptrace)
+	{
+		dumptrace = 0;
+		looptrace_dump();
+	}
+}
+
+/* Note a snapshot reload or hot path dump for the engine /**/
+static void handle_signal(int signum)
+{
+	if (signum == SIGUSR1)
+		dump = 1;
+	else if (signum == SIGUSR2)
+		dumptrace = 1;
+	else
+		reload = 1;
+}
+
+static void usage(void)
+{
+	errx(1, "RUN AS: ./server [--engine=name] [-B backlog] [-C max] "
+	    "[-D secs] [-F qlen] [-G bytes] [-K stack] [-L lowat] [-M bytes] "
+	    "[-R turns] [-S sndbuf] [-T policy] [-U path] [-Y on] "
+	    "[-a snapshot] [-b burst] [-c max] [-d dist] [-f config] "
+	    "[-l ms] [-m max] [-n cores] [-q max] [-r rate] [-w workers] "
+	    "[-z level] PORT "
+	    "/dir/documents /dir/logfile");
+}
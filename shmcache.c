@@ -0,0 +1,300 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Document cache shared by the children of the process engines.
+ *
+ * Compile using 'gcc -c shmcache.c' and link shmcache.o into a server
+ * with -lpthread.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf.h"
+#include "filecache.h"
+#include "lrucache.h"
+#include "response.h"
+#include "shmcache.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define SHM_EMPTY 0
+#define SHM_FILLING 1
+#define SHM_READY 2
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+struct shmregion
+{
+	pthread_mutex_t lock;		/* robust, process-shared /**/
+	int nslots;
+	struct shmslot slots[];
+};
+
+static const char ok_head[] = "HTTP/1.1 200 OK\nDate: ";
+
+static struct shmregion *shm;
+
+/*
+ * Take the index lock. If its holder died the lock is made usable
+ * again; every critical section sets a slot's state last, so what it
+ * left half done is at worst a slot that looks empty or still filling.
+ /**/
+static void shm_lock(void)
+{
+	if (pthread_mutex_lock(&shm->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&shm->lock);
+}
+
+static void shm_unlock(void)
+{
+	pthread_mutex_unlock(&shm->lock);
+}
+
+/* Check if a child pid still runs /**/
+static int shm_alive(pid_t pid)
+{
+	return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+/* Check if live children send or fill a slot. Hold the lock. /**/
+static int shm_busy(struct shmslot *s)
+{
+	int i, busy;
+
+	busy = 0;
+	for (i = 0; i < SHM_READERS; i++)
+		if (shm_alive(s->readers[i]))
+			busy = 1;
+		else
+			s->readers[i] = 0;
+	if (s->state == SHM_FILLING && shm_alive(s->owner))
+		busy = 1;
+	return busy;
+}
+
+/* Register this child as sending a slot. Hold the lock. /**/
+static int shm_enter(struct shmslot *s)
+{
+	pid_t pid = getpid();
+	int i;
+
+	for (i = 0; i < SHM_READERS; i++)
+		if (s->readers[i] == 0 || !shm_alive(s->readers[i]))
+		{
+			s->readers[i] = pid;
+			return 0;
+		}
+	return -1;
+}
+
+/*
+ * Map the shared region with a slot for every SHM_BLOCK of budget, in
+ * the parent before any child is forked.
+ /**/
+void shmcache_init(size_t budget)
+{
+	pthread_mutexattr_t attr;
+	size_t len;
+	int i, n;
+
+	if ((n = budget / SHM_BLOCK) < 1)
+		n = 1;
+	len = sizeof(*shm) + n * (sizeof(struct shmslot) + SHM_BLOCK);
+	shm = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shm == MAP_FAILED)
+		err(1, "can't map shared cache");
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (pthread_mutex_init(&shm->lock, &attr) != 0)
+		err(1, "can't init shared cache lock");
+	pthread_mutexattr_destroy(&attr);
+	shm->nslots = n;
+	for (i = 0; i < n; i++)
+		shm->slots[i].data = sizeof(*shm) + 
+		    n * sizeof(struct shmslot) + (size_t)i * SHM_BLOCK;
+}
+
+/*
+ * Return the cached document at path, held for the caller until
+ * shmcache_put(). The file is stat'd again at most every SHM_RECHECK
+ * seconds; NULL if it is not cached, changed or too busy.
+ /**/
+struct shmslot * shmcache_get(const char *path)
+{
+	struct shmslot *s;
+	struct stat st;
+	time_t now;
+
+	if (shm == NULL)
+		return NULL;
+	s = &shm->slots[lru_hash(path) % shm->nslots];
+	now = time(NULL);
+	shm_lock();
+	if (s->state != SHM_READY || strcmp(s->path, path) != 0)
+	{
+		shm_unlock();
+		return NULL;
+	}
+	if (now - s->checked >= SHM_RECHECK)
+	{
+		/* Checked unlocked, st is compared once locked again /**/
+		shm_unlock();
+		if (stat(path, &st) == -1)
+			return NULL;
+		shm_lock();
+		if (s->state != SHM_READY || strcmp(s->path, path) != 0 ||
+		    st.st_dev != s->fi.dev || st.st_ino != s->fi.ino ||
+		    st.st_size != s->fi.size || st.st_mtime != s->fi.mtime)
+		{
+			shm_unlock();
+			return NULL;
+		}
+		s->checked = now;
+	}
+	if (shm_enter(s) == -1)
+		s = NULL;
+	shm_unlock();
+	return s;
+}
+
+/*
+ * Cache the document at path, open as fd and described by fi, unless
+ * its slot is in use or it doesn't fit. Returns the slot held for the
+ * caller as shmcache_get() does, or NULL.
+ /**/
+struct shmslot * shmcache_fill(const char *path, int fd, 
+    const struct fileinfo *fi)
+{
+	char hdr[HDR_SIZE];
+	struct shmslot *s;
+	struct buf b;
+	char *block;
+	size_t n;
+	off_t got;
+	ssize_t r;
+
+	if (shm == NULL || strlen(path) >= SHM_PATH || 
+	    strlen(fi->type) >= sizeof(s->type))
+		return NULL;
+	/* The status line and Date are added when sending /**/
+	buf_init(&b, hdr, sizeof(hdr));
+	buf_append(&b, "\n", 1);
+	response_fields(&b, NULL, fi->size, fi);
+	buf_append(&b, "\n", 1);
+	n = b.len;
+	if (fi->size > SHM_BLOCK - n)
+		return NULL;
+
+	s = &shm->slots[lru_hash(path) % shm->nslots];
+	shm_lock();
+	if (shm_busy(s))
+	{
+		shm_unlock();
+		return NULL;
+	}
+	s->state = SHM_FILLING;
+	s->owner = getpid();
+	shm_unlock();
+
+	/* Nobody else touches a filling slot /**/
+	strlcpy(s->path, path, sizeof(s->path));
+	memcpy(&s->fi, fi, sizeof(s->fi));
+	strlcpy(s->type, fi->type, sizeof(s->type));
+	s->hdrlen = n;
+	block = (char *)shm + s->data;
+	memcpy(block, hdr, n);
+	for (got = 0; got < fi->size; got += r)
+	{
+		r = SYSBYTES(SC_FILE, pread(fd, block + n + got, 
+		    fi->size - got, got));
+		if (r == -1 && errno == EINTR)
+			r = 0;
+		else if (r <= 0)
+			break;
+	}
+
+	shm_lock();
+	if (got != fi->size || shm_enter(s) == -1)
+	{
+		s->state = SHM_EMPTY;
+		shm_unlock();
+		return NULL;
+	}
+	s->checked = time(NULL);
+	s->state = SHM_READY;
+	shm_unlock();
+	return s;
+}
+
+/* Release a slot returned by shmcache_get() or shmcache_fill() /**/
+void shmcache_put(struct shmslot *s)
+{
+	pid_t pid = getpid();
+	int i;
+
+	shm_lock();
+	for (i = 0; i < SHM_READERS; i++)
+		if (s->readers[i] == pid)
+		{
+			s->readers[i] = 0;
+			break;
+		}
+	shm_unlock();
+}
+
+/* Describe the cached document in fi /**/
+void shmcache_info(struct shmslot *s, struct fileinfo *fi)
+{
+	memcpy(fi, &s->fi, sizeof(*fi));
+	fi->type = s->type;
+}
+
+/*
+ * Point iov[0..SHM_IOVCNT-1] at a 200 OK for the cached document: status
+ * line, Date, header lines and body. A HEAD sends only the first
+ * SHM_IOVCNT - 1. Returns the total length.
+ /**/
+size_t shmcache_iov(struct shmslot *s, struct iovec *iov)
+{
+	char *block = (char *)shm + s->data;
+	size_t datelen;
+
+	iov[0].iov_base = (char *)ok_head;
+	iov[0].iov_len = sizeof(ok_head) - 1;
+	iov[1].iov_base = (char *)response_date(&datelen);
+	iov[1].iov_len = datelen;
+	iov[2].iov_base = block;
+	iov[2].iov_len = s->hdrlen;
+	iov[3].iov_base = block + s->hdrlen;
+	iov[3].iov_len = s->fi.size;
+	return iov[0].iov_len + datelen + s->hdrlen + s->fi.size;
+}
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Document cache shared by the children of the process engines.
+ *
+ * The parent maps one MAP_SHARED region before it accepts anything and
+ * every child it forks inherits it. The region holds a direct-mapped
+ * index of slots, each owning a fixed block for the rendered header
+ * lines and the body of one document. A child that misses fills a slot
+ * from the file it opened anyway; later children answer the document
+ * with one writev() out of the block, without opening the file.
+ *
+ * The index is guarded by a process-shared robust mutex, held only for
+ * a few field updates, so a child killed while holding it can't wedge
+ * the others. A slot is never refilled while a live child is sending
+ * from it: children register their pid as readers, and pids of dead
+ * children are cleared when found.
+ */
+
+#ifndef SHMCACHE_H
+#define SHMCACHE_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "filecache.h"
+
+/* Defined Variables /**/
+#define SHM_BLOCK (128 * 1024)	/* header lines and body of one slot /**/
+#define SHM_PATH 256
+#define SHM_READERS 8		/* children sending one slot at once /**/
+#define SHM_RECHECK 1		/* seconds a slot is trusted unchecked /**/
+#define SHM_IOVCNT 4		/* iovecs of a 200 OK from a slot /**/
+
+struct shmslot
+{
+	char path[SHM_PATH];		/* file name, sidecar suffix included /**/
+	int state;			/* SHM_EMPTY, SHM_FILLING or SHM_READY /**/
+	pid_t owner;			/* child filling the slot /**/
+	pid_t readers[SHM_READERS];	/* children sending the slot /**/
+	time_t checked;			/* when the file was last stat'd /**/
+	struct fileinfo fi;		/* validators, type is not kept /**/
+	char type[64];			/* Content-Type /**/
+	size_t hdrlen;			/* length of the header lines /**/
+	size_t data;			/* offset of the block in the region /**/
+};
+
+void             shmcache_init(size_t);
+struct shmslot * shmcache_get(const char *);
+struct shmslot * shmcache_fill(const char *, int, const struct fileinfo *);
+void             shmcache_put(struct shmslot *);
+void             shmcache_info(struct shmslot *, struct fileinfo *);
+size_t           shmcache_iov(struct shmslot *, struct iovec *);
+
+#endif /* SHMCACHE_H */
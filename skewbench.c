@@ -0,0 +1,343 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load generator for a skewed workload: most requests are cheap, a few
+ * are for a large document read by a deliberately slow client, which
+ * holds a server_p worker for as long as it takes. Reports latency
+ * percentiles for each class, to compare the -d policies of server_p's
+ * worker pool.
+ *
+ * Compile using 'make skewbench' or 'make all'
+ *
+ * Run as ./skewbench [-c clients] [-n requests] [-p percent] [-s ms]
+ *     [-y] 127.0.0.1 8000 /light.html /heavy.bin
+ * where clients connections run at once, requests are made in all,
+ * percent of them are for the heavy document, and the slow client
+ * sleeps ms between 4KB reads of it. A HOST starting with '/' or '@'
+ * is a Unix domain socket path (or abstract name), PORT is then ignored.
+ * -y prints the server's syscall counts afterwards, for a server run
+ * with "-Y on" and started fresh for the benchmark.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Defined Variables /**/
+#define BUF_SIZE 4096
+#define LIGHT 0
+#define HEAVY 1
+#define STATUS_PATH "/server-status"
+
+struct client
+{
+	pthread_t thread;
+	unsigned int seed;
+	int requests;
+	double *lat[2];		/* ms per request of each class /**/
+	int n[2];
+	int failed;
+};
+
+struct sockaddr_in server;
+struct sockaddr_un userver;	/* used when sun_family is set /**/
+socklen_t userverlen;
+const char *paths[2];
+int heavy_percent = 5;
+int slow_ms = 2;
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+/* Milliseconds since ts /**/
+static double elapsed(const struct timespec *ts)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - ts->tv_sec) * 1e3 + 
+	    (now.tv_nsec - ts->tv_nsec) / 1e6;
+}
+
+/*
+ * Connect to the server and ask for path, with a receive window of
+ * rcvbuf bytes unless 0. Returns the socket or -1.
+ /**/
+static int ask(const char *path, int rcvbuf)
+{
+	char buf[BUF_SIZE];
+	int sd, len;
+
+	if ((sd = socket(userver.sun_family ? AF_UNIX : AF_INET, 
+	    SOCK_STREAM, 0)) == -1)
+		err(1, "socket failed");
+	if (rcvbuf > 0)
+		setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	if ((userver.sun_family ? connect(sd, (struct sockaddr *)&userver, 
+	    userverlen) : connect(sd, (struct sockaddr *)&server, 
+	    sizeof(server))) == -1)
+	{
+		close(sd);
+		return -1;
+	}
+	len = snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: bench\r\n"
+	    "User-Agent: skewbench\r\n\r\n", path);
+	if (write(sd, buf, len) != len)
+	{
+		close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+/* Make one request of class, return 0 if a whole response came back /**/
+static int fetch(int class)
+{
+	char buf[BUF_SIZE];
+	ssize_t r;
+	int sd, ok;
+
+	/* A small window so the server blocks writing to a slow client /**/
+	if ((sd = ask(paths[class], class == HEAVY ? BUF_SIZE : 0)) == -1)
+		return -1;
+	ok = 0;
+	while ((r = read(sd, buf, sizeof(buf))) != 0)
+	{
+		if (r == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (!ok)
+			ok = r > 12 && strncmp(buf + 9, "200", 3) == 0;
+		if (class == HEAVY && slow_ms > 0)
+			usleep(slow_ms * 1000);
+	}
+	close(sd);
+	return ok && r == 0 ? 0 : -1;
+}
+
+/* Run one client's share of the requests /**/
+static void * run(void *arg)
+{
+	struct client *c = arg;
+	struct timespec start;
+	int i, class;
+
+	for (i = 0; i < c->requests; i++)
+	{
+		class = rand_r(&c->seed) % 100 < heavy_percent ? HEAVY : LIGHT;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (fetch(class) == -1)
+			c->failed++;
+		else
+			c->lat[class][c->n[class]++] = elapsed(&start);
+	}
+	return NULL;
+}
+
+/* Print the syscall lines of the server's status page /**/
+static void syscalls(void)
+{
+	char buf[16 * BUF_SIZE];
+	char phase[16], status[8];
+	char *line, *next;
+	unsigned long requests;
+	double calls, bytes, us;
+	ssize_t r;
+	size_t len;
+	int sd;
+
+	if ((sd = ask(STATUS_PATH, 0)) == -1)
+		err(1, "can't fetch %s", STATUS_PATH);
+	for (len = 0; len < sizeof(buf) - 1; len += r)
+		if ((r = read(sd, buf + len, sizeof(buf) - 1 - len)) <= 0)
+			break;
+	close(sd);
+	buf[len] = '\0';
+	printf("%-8s %6s %8s %9s %9s %9s\n", "phase", "status", "requests",
+	    "calls", "bytes", "us");
+	for (line = buf; line != NULL; line = next)
+	{
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		/* "syscalls status requests ..." then each phase /**/
+		if (sscanf(line, "syscalls_%15s %7s %lf %lf %lf", phase, 
+		    status, &calls, &bytes, &us) == 5)
+			printf("%-8s %6s %8s %9.2f %9.0f %9.1f\n", phase, 
+			    status, "", calls, bytes, us);
+		else if (sscanf(line, "syscalls %7s %lu %lf %lf %lf", 
+		    status, &requests, &calls, &bytes, &us) == 5)
+			printf("%-8s %6s %8lu %9.2f %9.0f %9.1f\n", "all", 
+			    status, requests, calls, bytes, us);
+	}
+}
+
+static void usage(void)
+{
+	errx(1, "RUN AS: ./skewbench [-c clients] [-n requests] "
+	    "[-p percent] [-s ms] [-y] HOST PORT /light /heavy");
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Print the latency percentiles of n samples /**/
+static void report(const char *name, double *lat, int n)
+{
+	double sum;
+	int i;
+
+	if (n == 0)
+	{
+		printf("%-6s %6d\n", name, 0);
+		return;
+	}
+	qsort(lat, n, sizeof(*lat), cmp);
+	for (sum = 0, i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%-6s %6d %9.2f %9.2f %9.2f %9.2f %9.2f\n", name, n, sum / n,
+	    lat[n / 2], lat[n * 90 / 100], lat[n * 99 / 100], lat[n - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct client *clients;
+	struct timespec start;
+	double *all[2], secs;
+	char *ep;
+	int nclients = 32, requests = 2000, counts = 0;
+	int ch, i, n[2], failed;
+
+	while ((ch = getopt(argc, argv, "c:n:p:s:y")) != -1)
+	{
+		if (ch == 'y')
+		{
+			counts = 1;
+			continue;
+		}
+		switch (ch)
+		{
+		case 'c':
+			nclients = strtol(optarg, &ep, 10);
+			break;
+		case 'n':
+			requests = strtol(optarg, &ep, 10);
+			break;
+		case 'p':
+			heavy_percent = strtol(optarg, &ep, 10);
+			break;
+		case 's':
+			slow_ms = strtol(optarg, &ep, 10);
+			break;
+		default:
+			usage();
+		}
+		if (*optarg == '\0' || *ep != '\0')
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 4 || nclients < 1 || requests < nclients)
+		usage();
+
+	memset(&server, 0, sizeof(server));
+	memset(&userver, 0, sizeof(userver));
+	if (argv[0][0] == '/' || argv[0][0] == '@')
+	{
+		if (strlcpy(userver.sun_path, argv[0],
+		    sizeof(userver.sun_path)) >= sizeof(userver.sun_path))
+			errx(1, "socket path too long %s", argv[0]);
+		userver.sun_family = AF_UNIX;
+		userverlen = offsetof(struct sockaddr_un, sun_path) + 
+		    strlen(argv[0]);
+		if (argv[0][0] == '@')
+			userver.sun_path[0] = '\0';
+		else
+			userverlen++;
+	}
+	else
+	{
+		server.sin_family = AF_INET;
+		server.sin_port = htons(atoi(argv[1]));
+		if (inet_pton(AF_INET, argv[0], &server.sin_addr) != 1)
+			errx(1, "bad address %s", argv[0]);
+	}
+	paths[LIGHT] = argv[2];
+	paths[HEAVY] = argv[3];
+
+	if ((clients = calloc(nclients, sizeof(*clients))) == NULL)
+		err(1, "calloc failed");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nclients; i++)
+	{
+		clients[i].seed = i + 1;
+		clients[i].requests = requests / nclients;
+		if ((clients[i].lat[LIGHT] = calloc(clients[i].requests, 
+		    sizeof(double))) == NULL || (clients[i].lat[HEAVY] = 
+		    calloc(clients[i].requests, sizeof(double))) == NULL)
+			err(1, "calloc failed");
+		if (pthread_create(&clients[i].thread, NULL, run, &clients[i]))
+			errx(1, "unable to create thread");
+	}
+
+	/* Gather every client's samples by class /**/
+	for (i = 0; i < 2; i++)
+		if ((all[i] = calloc(requests, sizeof(double))) == NULL)
+			err(1, "calloc failed");
+	n[LIGHT] = n[HEAVY] = failed = 0;
+	for (i = 0; i < nclients; i++)
+	{
+		pthread_join(clients[i].thread, NULL);
+		for (ch = 0; ch < 2; ch++)
+		{
+			memcpy(all[ch] + n[ch], clients[i].lat[ch],
+			    clients[i].n[ch] * sizeof(double));
+			n[ch] += clients[i].n[ch];
+		}
+		failed += clients[i].failed;
+	}
+
+	secs = elapsed(&start) / 1e3;
+	printf("%.2f s, %d failed, %.0f requests/s\n", secs, failed,
+	    (n[LIGHT] + n[HEAVY]) / secs);
+	printf("%-6s %6s %9s %9s %9s %9s %9s\n", "class", "n", "mean ms",
+	    "p50", "p90", "p99", "max");
+	report("light", all[LIGHT], n[LIGHT]);
+	report("heavy", all[HEAVY], n[HEAVY]);
+	if (counts)
+		syscalls();
+	return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Packed snapshots of a document directory, the serving side.
+ *
+ * Compile using 'gcc -c snapshot.c' and link snapshot.o into each
+ * server (threads need -lpthread).
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "encoding.h"
+#include "filecache.h"
+#include "response.h"
+#include "snapshot.h"
+
+/* Function Prototypes /**/
+size_t strlcpy(char *, const char *, size_t);
+
+static const char ok_head[] = "HTTP/1.1 200 OK\nDate: ";
+
+static struct snapshot *current;
+static pthread_mutex_t snaplock = PTHREAD_MUTEX_INITIALIZER;
+static char snap_path[PATH_MAX];
+
+/*
+ * Hash of the len bytes at key under seed, FNV-1a with a final mix so
+ * the low bits taken by a small modulus are spread too.
+ /**/
+uint32_t snapshot_hash(const char *key, size_t len, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ (seed * 2654435761u);
+
+	while (len-- > 0)
+	{
+		h ^= (unsigned char)*key++;
+		h *= 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+/* Check a span of the archive lies inside it /**/
+static int snap_inside(const struct snapshot *s, uint64_t off, uint64_t len)
+{
+	return off <= s->len && len <= s->len - off;
+}
+
+/* Check a string of the archive is NUL terminated inside it /**/
+static int snap_string(const struct snapshot *s, uint64_t off)
+{
+	return off < s->len && memchr(s->map + off, '\0', s->len - off) != 
+	    NULL;
+}
+
+/* Release a mapped archive /**/
+static void snap_free(struct snapshot *s)
+{
+	munmap(s->map, s->len);
+	close(s->fd);
+	free(s);
+}
+
+/*
+ * Map the archive at path and check everything a lookup or a response
+ * will touch lies inside it, so a truncated or foreign file is refused
+ * here rather than faulting later. Returns NULL if it can't be used.
+ /**/
+static struct snapshot * snap_open(const char *path)
+{
+	const struct snapentry *e;
+	struct snapshot *s;
+	struct stat st;
+	uint32_t i;
+	int enc;
+
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return NULL;
+	if ((s->fd = open(path, O_RDONLY)) == -1)
+	{
+		free(s);
+		return NULL;
+	}
+	if (fstat(s->fd, &st) == -1 || st.st_size < sizeof(*s->hdr))
+	{
+		close(s->fd);
+		free(s);
+		return NULL;
+	}
+	s->len = st.st_size;
+	s->map = mmap(NULL, s->len, PROT_READ, MAP_SHARED, s->fd, 0);
+	if (s->map == MAP_FAILED)
+	{
+		close(s->fd);
+		free(s);
+		return NULL;
+	}
+
+	s->hdr = (const struct snapheader *)s->map;
+	if (memcmp(s->hdr->magic, SNAP_MAGIC, sizeof(s->hdr->magic)) != 0 ||
+	    s->hdr->version != SNAP_VERSION || s->hdr->size != s->len ||
+	    (s->hdr->count > 0 && s->hdr->nbuckets == 0) ||
+	    s->hdr->seeds % sizeof(uint32_t) != 0 ||
+	    s->hdr->entries % sizeof(uint64_t) != 0 ||
+	    !snap_inside(s, s->hdr->seeds, 
+	    (uint64_t)s->hdr->nbuckets * sizeof(uint32_t)) ||
+	    !snap_inside(s, s->hdr->entries, 
+	    (uint64_t)s->hdr->count * sizeof(struct snapentry)))
+	{
+		snap_free(s);
+		return NULL;
+	}
+	s->seeds = (const uint32_t *)(s->map + s->hdr->seeds);
+	s->entries = (const struct snapentry *)(s->map + s->hdr->entries);
+	for (i = 0; i < s->hdr->count; i++)
+	{
+		e = &s->entries[i];
+		if (!snap_inside(s, e->path, e->pathlen) || 
+		    !snap_string(s, e->type) || !e->v[ENC_IDENTITY].present)
+		{
+			snap_free(s);
+			return NULL;
+		}
+		for (enc = 0; enc < ENC_COUNT; enc++)
+			if (e->v[enc].present && 
+			    (!snap_inside(s, e->v[enc].hdr, e->v[enc].hdrlen) ||
+			    !snap_inside(s, e->v[enc].body, e->v[enc].size) ||
+			    memchr(e->v[enc].etag, '\0', FC_ETAG_SIZE) == NULL ||
+			    memchr(e->v[enc].lastmod, '\0', FC_DATE_SIZE) == 
+			    NULL))
+			{
+				snap_free(s);
+				return NULL;
+			}
+	}
+	return s;
+}
+
+/* Serve from the archive at path, returns -1 if it can't be mapped /**/
+int snapshot_init(const char *path)
+{
+	strlcpy(snap_path, path, sizeof(snap_path));
+	return snapshot_reload();
+}
+
+/*
+ * Map the archive again and make it the current snapshot. Requests
+ * still using the old one keep it until they snapshot_put() it. On
+ * failure the old snapshot stays and -1 is returned.
+ /**/
+int snapshot_reload(void)
+{
+	struct snapshot *s, *old;
+
+	if (snap_path[0] == '\0' || (s = snap_open(snap_path)) == NULL)
+		return -1;
+	s->refs = 1;
+	pthread_mutex_lock(&snaplock);
+	old = current;
+	current = s;
+	pthread_mutex_unlock(&snaplock);
+	if (old != NULL)
+		snapshot_put(old);
+	return 0;
+}
+
+/* The current snapshot, held until snapshot_put(), or NULL if none /**/
+struct snapshot * snapshot_get(void)
+{
+	struct snapshot *s;
+
+	pthread_mutex_lock(&snaplock);
+	if ((s = current) != NULL)
+		s->refs++;
+	pthread_mutex_unlock(&snaplock);
+	return s;
+}
+
+/* Release a snapshot, unmapping it once nobody uses it /**/
+void snapshot_put(struct snapshot *s)
+{
+	int refs;
+
+	pthread_mutex_lock(&snaplock);
+	refs = --s->refs;
+	pthread_mutex_unlock(&snaplock);
+	if (refs == 0)
+		snap_free(s);
+}
+
+/* Find the document at request path, ie) "/index.html", or NULL /**/
+const struct snapentry * snapshot_lookup(struct snapshot *s, 
+    const char *path)
+{
+	const struct snapentry *e;
+	size_t len;
+	uint32_t b;
+
+	if (s->hdr->count == 0)
+		return NULL;
+	len = strlen(path);
+	b = snapshot_hash(path, len, 0) % s->hdr->nbuckets;
+	e = &s->entries[snapshot_hash(path, len, s->seeds[b]) % 
+	    s->hdr->count];
+	if (e->pathlen != len || memcmp(s->map + e->path, path, len) != 0)
+		return NULL;
+	return e;
+}
+
+/* Describe coding enc of a document in fi, as filecache_stat() would /**/
+void snapshot_info(struct snapshot *s, const struct snapentry *e, int enc,
+    struct fileinfo *fi)
+{
+	const struct snapvariant *v = &e->v[enc];
+
+	memset(fi, 0, sizeof(*fi));
+	fi->size = v->size;
+	strlcpy(fi->etag, v->etag, sizeof(fi->etag));
+	strlcpy(fi->lastmod, v->lastmod, sizeof(fi->lastmod));
+	fi->type = s->map + e->type;
+	fi->encoding = enc;
+	fi->encodings = e->encodings;
+}
+
+/*
+ * Point iov[0..SNAP_IOVCNT-1] at a 200 OK for coding enc of a document:
+ * status line, Date, header lines and body. A HEAD sends only the first
+ * SNAP_IOVCNT - 1. Returns the total length.
+ /**/
+size_t snapshot_iov(struct snapshot *s, const struct snapentry *e, int enc,
+    struct iovec *iov)
+{
+	const struct snapvariant *v = &e->v[enc];
+	size_t datelen;
+
+	iov[0].iov_base = (char *)ok_head;
+	iov[0].iov_len = sizeof(ok_head) - 1;
+	iov[1].iov_base = (char *)response_date(&datelen);
+	iov[1].iov_len = datelen;
+	iov[2].iov_base = s->map + v->hdr;
+	iov[2].iov_len = v->hdrlen;
+	iov[3].iov_base = s->map + v->body;
+	iov[3].iov_len = v->size;
+	return iov[0].iov_len + datelen + v->hdrlen + v->size;
+}
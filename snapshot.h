@@ -0,0 +1,110 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Packed snapshots of a document directory.
+ *
+ * mksnapshot packs every file under /dir/documents, with its sidecars,
+ * into one archive:
+ *
+ *	struct snapheader
+ *	path strings, Content-Types, rendered headers and bodies
+ *	uint32_t seeds[nbuckets]	perfect hash displacements
+ *	struct snapentry entries[count]	indexed by the perfect hash
+ *
+ * A server maps the archive once and answers from it without opening,
+ * stat'ing or reading any file: a path is found with two hashes, and a
+ * 200 OK is a writev() of the status line, the Date, the header lines
+ * rendered by mksnapshot and the body, all in the shared page cache.
+ * SIGHUP maps the archive again so a new snapshot can be swapped in by
+ * renaming it over the old one.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <stdint.h>
+
+#include "encoding.h"
+#include "filecache.h"
+
+/* Defined Variables /**/
+#define SNAP_MAGIC "c379snap"
+#define SNAP_VERSION 1
+#define SNAP_IOVCNT 4		/* iovecs of a 200 OK from a snapshot /**/
+
+struct snapheader
+{
+	char magic[8];			/* SNAP_MAGIC /**/
+	uint32_t version;		/* SNAP_VERSION /**/
+	uint32_t count;			/* number of documents /**/
+	uint32_t nbuckets;		/* number of hash seeds /**/
+	uint32_t pad;
+	uint64_t seeds;			/* offset of the seeds /**/
+	uint64_t entries;		/* offset of the entries /**/
+	uint64_t size;			/* archive length /**/
+};
+
+/* One coding of a document, offsets are from the archive start /**/
+struct snapvariant
+{
+	uint64_t hdr;			/* header lines, blank line included /**/
+	uint64_t body;			/* body /**/
+	uint64_t size;			/* body length /**/
+	uint32_t hdrlen;		/* length of the header lines /**/
+	uint32_t present;		/* 1 if the document has this coding /**/
+	char etag[FC_ETAG_SIZE];	/* validators of this coding /**/
+	char lastmod[FC_DATE_SIZE];
+};
+
+struct snapentry
+{
+	uint64_t path;			/* request path, ie) "/index.html" /**/
+	uint64_t type;			/* Content-Type /**/
+	uint32_t pathlen;
+	uint32_t encodings;		/* ENC_BIT mask of stored codings /**/
+	struct snapvariant v[ENC_COUNT];
+};
+
+struct snapshot
+{
+	char *map;			/* the archive, read only /**/
+	size_t len;
+	int fd;				/* for pread() of byte ranges /**/
+	int refs;			/* users, and being the current one /**/
+	const struct snapheader *hdr;
+	const uint32_t *seeds;
+	const struct snapentry *entries;
+};
+
+uint32_t                 snapshot_hash(const char *, size_t, uint32_t);
+int                      snapshot_init(const char *);
+int                      snapshot_reload(void);
+struct snapshot *        snapshot_get(void);
+void                     snapshot_put(struct snapshot *);
+const struct snapentry * snapshot_lookup(struct snapshot *, const char *);
+void                     snapshot_info(struct snapshot *, 
+                             const struct snapentry *, int, 
+                             struct fileinfo *);
+size_t                   snapshot_iov(struct snapshot *,
+                             const struct snapentry *, int, 
+                             struct iovec *);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Status page.
+ *
+ * Compile using 'gcc -c status.c' and link status.o into each server.
+ */
+
+#include <sys/types.h>
+
+#include <string.h>
+
+#include "admission.h"
+#include "buf.h"
+#include "config.h"
+#include "hotpath.h"
+#include "listener.h"
+#include "memory.h"
+#include "response.h"
+#include "status.h"
+#include "syscount.h"
+
+/* Check if the request for path from client ip gets the status page /**/
+int status_request(const char *path, const char *ip)
+{
+	if (strcmp(path, STATUS_PATH) != 0)
+		return 0;
+	return listener_local(ip) || 
+	    strncmp(ip, STATUS_LOOPBACK, strlen(STATUS_LOOPBACK)) == 0;
+}
+
+/* Append the whole status response to b, return its length /**/
+size_t status_response(struct buf *b)
+{
+	struct buf body;
+	size_t start = b->len;
+
+	buf_init(&body, NULL, 0);
+	admission_status(&body);
+	memory_status(&body);
+	config_status(&body);
+	hotpath_status(&body);
+	syscount_status(&body);
+	/* All or nothing, like the header /**/
+	if (response_header(b, "200 OK", "text/plain", body.len, NULL,
+	    "Cache-Control: no-store\n") == 0 ||
+	    buf_append(b, body.data, body.len) == -1)
+	{
+		b->len = start;
+		if (b->cap > start)
+			b->data[start] = '\0';
+	}
+	buf_free(&body);
+	return b->len - start;
+}
@@ -0,0 +1,43 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Status page shared by every server engine.
+ *
+ * A GET of STATUS_PATH is answered by the server itself, never from the
+ * document directory, with the server's counters as text/plain lines
+ * of "name value" that a load balancer or script can poll. It tells
+ * of clients, configuration and memory, so only clients on the Unix
+ * domain socket or loopback get it; others are answered as if there
+ * were no such page.
+ */
+
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <sys/types.h>
+
+/* Defined Variables /**/
+#define STATUS_PATH "/server-status"
+#define STATUS_LOOPBACK "127."	/* addresses of loopback clients /**/
+
+struct buf;
+
+int    status_request(const char *, const char *);
+size_t status_response(struct buf *);
+
+#endif /* STATUS_H */
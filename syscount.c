@@ -0,0 +1,255 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Syscall accounting.
+ *
+ * Compile using 'gcc -c syscount.c' and link syscount.o into each
+ * server.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "buf.h"
+#include "syscount.h"
+
+/* Defined Variables /**/
+#define SC_STATUSES 11		/* those below, then any other /**/
+#define SC_NONE SC_STATUSES	/* calls serving no request /**/
+
+struct syscount
+{
+	unsigned long requests[SC_STATUSES];
+	struct sccount phase[SC_STATUSES + 1][SC_PHASES];
+};
+
+static const char *statuses[SC_STATUSES] = {
+	"200", "206", "304", "400", "403", "404", "416", "429", "500", 
+	"503", "other"
+};
+
+static const char *phases[SC_PHASES] = {
+	"accept", "idle", "wait", "read", "open", "file", "write", "close", 
+	"log"
+};
+
+int syscount_on;
+static struct syscount *sc;
+
+/* Calls of this thread not yet charged, and the set counted in /**/
+static __thread struct scset pending;
+static __thread struct scset *counting;
+
+/* A child charges the call that accepted it, the parent doesn't /**/
+static void syscount_forked(void)
+{
+	memset(&pending, 0, sizeof(pending));
+	counting = NULL;
+}
+
+/*
+ * Turn accounting on when on is set. The counters are mapped shared
+ * so forked children update the parent's copy.
+ /**/
+void syscount_init(int on)
+{
+	if (!on)
+		return;
+	sc = mmap(NULL, sizeof(*sc), PROT_READ | PROT_WRITE, 
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sc == MAP_FAILED)
+		err(1, "can't map syscall counters");
+	if (pthread_atfork(NULL, syscount_forked, NULL) != 0)
+		errx(1, "can't watch for forks");
+	syscount_on = 1;
+}
+
+/* Parse the accounting mode given on the command line /**/
+int syscount_mode(const char *arg)
+{
+	if (strcmp(arg, "on") == 0)
+		return 1;
+	if (strcmp(arg, "off") == 0)
+		return 0;
+	errx(1, "syscalls must be on or off");
+}
+
+/* Monotonic nanoseconds, from the vDSO without a syscall /**/
+long long syscount_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Count a call in phase made since start, moving bytes /**/
+void syscount_add(int phase, long long start, size_t bytes)
+{
+	struct sccount *p;
+	int saved = errno;
+
+	p = &(counting != NULL ? counting : &pending)->phase[phase];
+
+	p->calls++;
+	p->bytes += bytes;
+	p->nsec += syscount_now() - start;
+	errno = saved;
+}
+
+/*
+ * Add the calls of set s to the counters of row, then clear s. Idle
+ * time is no request's, it always goes to SC_NONE.
+ /**/
+static void syscount_charge(struct scset *s, int row)
+{
+	struct sccount *p, *t;
+	int i;
+
+	for (i = 0; i < SC_PHASES; i++)
+	{
+		p = &s->phase[i];
+		if (p->calls == 0)
+			continue;
+		t = &sc->phase[i == SC_IDLE ? SC_NONE : row][i];
+		__atomic_add_fetch(&t->calls, p->calls, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&t->bytes, p->bytes, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&t->nsec, p->nsec, __ATOMIC_RELAXED);
+		memset(p, 0, sizeof(*p));
+	}
+}
+
+/*
+ * Charge the calls so far to a request finished with completion. A
+ * connection's set only notes the status, it is charged when closed.
+ /**/
+void syscount_request(const char *completion)
+{
+	int i;
+
+	if (!syscount_on)
+		return;
+	for (i = 0; i < SC_STATUSES - 1; i++)
+		if (strncmp(completion, statuses[i], 3) == 0)
+			break;
+	__atomic_add_fetch(&sc->requests[i], 1, __ATOMIC_RELAXED);
+	if (counting != NULL)
+		counting->status = i + 1;
+	else
+		syscount_charge(&pending, i);
+}
+
+/* Count this thread's calls in the set of a connection /**/
+void syscount_begin(struct scset *s)
+{
+	if (syscount_on)
+		counting = s;
+}
+
+/* Count this thread's calls as its own again /**/
+void syscount_end(void)
+{
+	counting = NULL;
+}
+
+/*
+ * Charge the calls of a closed connection to the status it logged,
+ * or to no request if it logged none.
+ /**/
+void syscount_close(struct scset *s)
+{
+	if (syscount_on)
+		syscount_charge(s, s->status != 0 ? s->status - 1 : SC_NONE);
+}
+
+/* Charge the calls so far to no request /**/
+void syscount_flush(void)
+{
+	if (syscount_on)
+		syscount_charge(&pending, SC_NONE);
+}
+
+/* Append a status line: label, calls, bytes and us a request /**/
+static void syscount_line(struct buf *b, const char *label, 
+    unsigned long requests, const struct sccount *c)
+{
+	buf_printf(b, "%s %.2f %.0f %.1f\n", label, 
+	    (double)c->calls / requests, (double)c->bytes / requests, 
+	    c->nsec / 1e3 / requests);
+}
+
+/*
+ * Append the counters to b, for each status answered: "syscalls
+ * status requests calls bytes us" then a "syscalls_phase status calls
+ * bytes us" line for each phase called in, all per request. Calls made
+ * serving no request are the status "-", over every request.
+ * Returns the length appended.
+ /**/
+size_t syscount_status(struct buf *b)
+{
+	struct sccount all, c;
+	unsigned long requests, total;
+	const char *status;
+	char label[64];
+	size_t start = b->len;
+	int i, j;
+
+	if (!syscount_on)
+		return 0;
+	total = 0;
+	for (i = 0; i < SC_STATUSES; i++)
+		total += __atomic_load_n(&sc->requests[i], __ATOMIC_RELAXED);
+	for (i = 0; i <= SC_STATUSES; i++)
+	{
+		requests = i == SC_NONE ? total : 
+		    __atomic_load_n(&sc->requests[i], __ATOMIC_RELAXED);
+		if (requests == 0)
+			continue;
+		memset(&all, 0, sizeof(all));
+		for (j = 0; j < SC_PHASES; j++)
+		{
+			all.calls += sc->phase[i][j].calls;
+			all.bytes += sc->phase[i][j].bytes;
+			all.nsec += sc->phase[i][j].nsec;
+		}
+		if (i == SC_NONE && all.calls == 0)
+			continue;
+		status = i == SC_NONE ? "-" : statuses[i];
+		snprintf(label, sizeof(label), "syscalls %s %lu", status, 
+		    requests);
+		syscount_line(b, label, requests, &all);
+		for (j = 0; j < SC_PHASES; j++)
+		{
+			c = sc->phase[i][j];
+			if (c.calls == 0)
+				continue;
+			snprintf(label, sizeof(label), "syscalls_%s %s", 
+			    phases[j], status);
+			syscount_line(b, label, requests, &c);
+		}
+	}
+	return b->len - start;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Syscall accounting: how many calls, bytes and time each request
+ * costs, by phase and by response status.
+ *
+ * The I/O calls on the request path are made through SYSCOUNT() or
+ * SYSBYTES(). With accounting off (the default) that is one test of
+ * syscount_on; with it on each call is timed and counted in the
+ * calling thread's own counters, which logfile_write() charges to the
+ * request it logs. An event loop counts the calls made for a
+ * connection in the connection's own scset between syscount_begin()
+ * and syscount_end(), and charges them with syscount_close() once it
+ * is closed, to the status it logged. Waits, accepts and whatever else
+ * serves no single request, in a loop or in the acceptors and cache
+ * loaders, are given to syscount_flush(). The counters are shared by
+ * forked children and shown on STATUS_PATH.
+ */
+
+#ifndef SYSCOUNT_H
+#define SYSCOUNT_H
+
+#include <sys/types.h>
+
+/* Phases a call is counted in /**/
+#define SC_ACCEPT 0		/* accept(), accept4() /**/
+#define SC_IDLE 1		/* waiting for a connection to serve /**/
+#define SC_WAIT 2		/* a loop waiting on open connections /**/
+#define SC_READ 3		/* reading the request /**/
+#define SC_OPEN 4		/* fopen(), open(), stat() of a document /**/
+#define SC_FILE 5		/* reading a document /**/
+#define SC_WRITE 6		/* writing the response /**/
+#define SC_CLOSE 7		/* closing documents and connections /**/
+#define SC_LOG 8		/* opening and writing the log /**/
+#define SC_PHASES 9
+
+/* Time call as one in phase, giving its result /**/
+#define SYSCOUNT(phase, call) __extension__ ({ \
+	long long sc_t = syscount_on ? syscount_now() : 0; \
+	__typeof__(call) sc_r = (call); \
+	if (syscount_on) \
+		syscount_add(phase, sc_t, 0); \
+	sc_r; \
+})
+
+/* As SYSCOUNT() for a call returning the bytes it moved /**/
+#define SYSBYTES(phase, call) __extension__ ({ \
+	long long sc_t = syscount_on ? syscount_now() : 0; \
+	__typeof__(call) sc_r = (call); \
+	if (syscount_on) \
+		syscount_add(phase, sc_t, sc_r > 0 ? sc_r : 0); \
+	sc_r; \
+})
+
+struct buf;
+
+struct sccount
+{
+	unsigned long calls;
+	unsigned long long bytes;
+	unsigned long long nsec;
+};
+
+/* Calls made for one connection, not yet charged /**/
+struct scset
+{
+	struct sccount phase[SC_PHASES];
+	int status;			/* status row logged plus 1, or 0 /**/
+};
+
+extern int syscount_on;
+
+void      syscount_init(int);
+int       syscount_mode(const char *);
+long long syscount_now(void);
+void      syscount_add(int, long long, size_t);
+void      syscount_request(const char *);
+void      syscount_begin(struct scset *);
+void      syscount_end(void);
+void      syscount_close(struct scset *);
+void      syscount_flush(void);
+size_t    syscount_status(struct buf *);
+
+#endif /* SYSCOUNT_H */
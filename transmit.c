@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Socket options set around each response.
+ *
+ * Compile using 'gcc -c transmit.c' and link transmit.o into each server.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <err.h>
+#include <string.h>
+
+#include "response.h"
+#include "transmit.h"
+
+static int policy = TX_NONE;
+static int sndbuf;		/* most SO_SNDBUF a response gets, 0 is off /**/
+static int lowat;		/* TCP_NOTSENT_LOWAT bytes, 0 is off /**/
+
+/* Set the policy, send buffer cap and unsent low water mark /**/
+void transmit_init(int pol, int maxsndbuf, int notsent)
+{
+	policy = pol;
+	sndbuf = maxsndbuf;
+	lowat = notsent;
+}
+
+/* TX_ policy named by arg, ie) "cork" /**/
+int transmit_policy(const char *arg)
+{
+	if (strcmp(arg, "none") == 0)
+		return TX_NONE;
+	if (strcmp(arg, "cork") == 0)
+		return TX_CORK;
+	if (strcmp(arg, "nodelay") == 0)
+		return TX_NODELAY;
+	errx(1, "policy must be none, cork or nodelay");
+}
+
+/* A connection was accepted, set it up for its response /**/
+void transmit_open(int sd)
+{
+	int one = 1;
+
+	if (policy == TX_CORK)
+		setsockopt(sd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one));
+	else if (policy == TX_NODELAY)
+		setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (lowat > 0)
+		setsockopt(sd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+		    sizeof(lowat));
+}
+
+/* The response on sd has a body of length bytes /**/
+void transmit_size(int sd, off_t length)
+{
+	int n;
+
+	if (sndbuf <= 0)
+		return;
+	n = length + HDR_SIZE < sndbuf ? length + HDR_SIZE : sndbuf;
+	setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &n, sizeof(n));
+}
+
+/* The whole response is written, let anything held back go /**/
+void transmit_close(int sd)
+{
+	int zero = 0;
+
+	if (policy == TX_CORK)
+		setsockopt(sd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero));
+}
@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2013 Alexander Wong <admin@alexander-wong.com>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per response socket policies shared by every server engine.
+ *
+ * Every connection carries one response, so transmit_open() after
+ * accept() and transmit_close() once the response is written bracket
+ * exactly one response. With TX_CORK the header and body are held
+ * back and leave in full segments when the cork comes out; with
+ * TX_NODELAY every write goes out at once instead of waiting on
+ * Nagle for the ACK of the one before. transmit_size() sizes the send
+ * buffer to the response, up to a cap, so a large body is handed to
+ * the kernel in as few writes as possible, and TCP_NOTSENT_LOWAT keeps
+ * what sits unsent in the kernel small so server_s is woken to write
+ * more only when it is needed.
+ */
+
+#ifndef TRANSMIT_H
+#define TRANSMIT_H
+
+#include <sys/types.h>
+
+/* Policies of transmit_init() /**/
+#define TX_NONE 0
+#define TX_CORK 1
+#define TX_NODELAY 2
+
+void transmit_init(int, int, int);
+int  transmit_policy(const char *);
+void transmit_open(int);
+void transmit_size(int, off_t);
+void transmit_close(int);
+
+#endif /* TRANSMIT_H */